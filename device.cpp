@@ -1,22 +1,69 @@
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstdarg>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
+#include <limits>
 #include <string>
+#include <vector>
 
+#include "device.h"
+#include "util.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define USE_SSE2_CLEAR 1
+#else
+#define USE_SSE2_CLEAR 0
+#endif
+
+
+// set this to 1 to render without a window (or SDL at all).  Frames are still
+// drawn into the framebuffer and z buffer as usual, but updateScreen() only
+// counts frames and optionally dumps them to disk, so this is useful for
+// measuring raw rasterizer throughput on machines without a display.
+#ifndef DEVICE_HEADLESS
+#define DEVICE_HEADLESS 0
+#endif
+
+#if DEVICE_HEADLESS
+// the headless device stops running after this many frames (0 means never)
+#ifndef HEADLESS_FRAME_LIMIT
+#define HEADLESS_FRAME_LIMIT 600
+#endif
+
+// every Nth frame is written to HEADLESS_DUMP_FORMAT (0 means never)
+#ifndef HEADLESS_DUMP_INTERVAL
+#define HEADLESS_DUMP_INTERVAL 0
+#endif
+
+#ifndef HEADLESS_DUMP_FORMAT
+#define HEADLESS_DUMP_FORMAT "frame_%05d.ppm"
+#endif
+#else
 #ifdef _MSC_VER
 #include <SDL.h>
 #else
 #include <SDL2/SDL.h>
 #endif
+#endif
 
-#include "device.h"
-#include "util.h"
 
+// set this to 1 to only clear the tiles of the framebuffer and z buffer that
+// were drawn to since the last clear, instead of all of them.  It only pays off
+// when most of the screen is background, since setPixel() has to flag tiles.
+#ifndef LAZY_CLEAR
+#define LAZY_CLEAR 0
+#endif
+
+// lazily cleared tiles are 32 x 32 pixels
+#define CLEAR_TILE_SHIFT 5
 
-// TODO: make this stuff configurable
-// fixed 4:3 aspect ratio for now (see also Scene::init())
-#define RES_X 1024
-#define RES_Y RES_X / 4 * 3
+// the render scale can't drop below this, otherwise the internal resolution
+// could round down to nothing
+#define MIN_RENDER_SCALE 0.1
 
 #ifdef _MSC_VER
 #define MOUSE_SENSITIVITY_FACTOR 100
@@ -27,7 +74,9 @@
 
 // logic to log the number of C++ memory allocations are happening behind the
 // scenes
+#ifndef LOG_MEMORY_ALLOCATIONS
 #define LOG_MEMORY_ALLOCATIONS 0
+#endif
 #if LOG_MEMORY_ALLOCATIONS
 int new_calls = 0;
 int delete_calls = 0;
@@ -50,26 +99,245 @@ void printMemoryAllocations() {
 #endif
 
 
+// the resolution of the window (or of dumped frames)
+unsigned int output_x_res = device::kDefaultXRes;
+unsigned int output_y_res = device::kDefaultYRes;
+
+// the internal resolution everything is actually rasterized at, which is the
+// output resolution multiplied by the render scale
+unsigned int x_res = device::kDefaultXRes;
+unsigned int y_res = device::kDefaultYRes;
+double render_scale = 1.0;
+
 // the framebuffer
+// both it and the z buffer are allocated for the full output resolution, so
+// lowering the render scale only changes how much of them is used
 typedef struct {
-	uint32_t data[RES_X * RES_Y];
-	int bytes_per_line;  // not actually used anywhere
+	uint32_t* data;
+	int bytes_per_line;
 } pixeldata;
 
-pixeldata pixels = {
-		{0},
-		RES_X * 4};
+pixeldata pixels = {nullptr, 0};
+
+device::depth_t* zbuffer = nullptr;
+
+// the hierarchical z buffer, see device::tileFarthestDepth()
+// besides the farthest depth of each tile, the farthest depth of each row of
+// each tile is kept, so tiles can be updated one row at a time
+unsigned int depth_tiles_x = 0;
+unsigned int depth_tiles_y = 0;
+device::depth_t* depth_tiles = nullptr;
+device::depth_t* depth_tile_rows = nullptr;
 
-double zbuffer[RES_X * RES_Y];
+void hierarchicalZReset() {
+	memset(
+			depth_tiles,
+			0,
+			depth_tiles_x * depth_tiles_y * sizeof(device::depth_t));
+
+	unsigned int padded_rows = depth_tiles_y << device::kDepthTileShift;
+
+	memset(depth_tile_rows, 0, y_res * depth_tiles_x * sizeof(device::depth_t));
+
+	// rows past the top of the screen shouldn't hold their tiles back
+	std::fill(
+			depth_tile_rows + y_res * depth_tiles_x,
+			depth_tile_rows + padded_rows * depth_tiles_x,
+			std::numeric_limits<device::depth_t>::max());
+}
 
 void zBufferReset() {
-	memset(zbuffer, 0, RES_X * RES_Y * sizeof(double));
+	memset(zbuffer, 0, x_res * y_res * sizeof(device::depth_t));
+
+	hierarchicalZReset();
 }
 
+unsigned int depthTileCount(unsigned int resolution) {
+	return (resolution + device::kDepthTileSize - 1) >> device::kDepthTileShift;
+}
+
+// for lazy clearing, setPixel() flags the tile of every pixel it draws, and
+// clearScreen() only clears the flagged tiles.  Nothing writes to the z buffer
+// without also drawing the pixel, so this covers the z buffer too.
+// the flags are atomic because the TileRasterizer draws from several threads,
+// and neighboring tiles' flags can share a cache line
+unsigned int clear_tiles_x = 0;
+unsigned int clear_tiles_y = 0;
+std::atomic<unsigned char>* drawn_tiles = nullptr;
+
+// lazy clears also rely on the framebuffer still holding the last clear color
+// everywhere that wasn't drawn to
+bool needs_full_clear = true;
+uint32_t last_clear_color = 0;
+
+unsigned int clearTileCount(unsigned int resolution) {
+	return (resolution + (1 << CLEAR_TILE_SHIFT) - 1) >> CLEAR_TILE_SHIFT;
+}
+
+void fillPixels(uint32_t* destination, size_t count, uint32_t color) {
+	size_t i = 0;
+
+#if USE_SSE2_CLEAR
+	// scalar until the destination is aligned, then a cache line at a time
+	for (; i < count && ((uintptr_t)(destination + i) & 15) != 0; i++) {
+		destination[i] = color;
+	}
+
+	__m128i colors = _mm_set1_epi32(color);
+
+	for (; i + 16 <= count; i += 16) {
+		__m128i* line = (__m128i*)(destination + i);
+		_mm_store_si128(line, colors);
+		_mm_store_si128(line + 1, colors);
+		_mm_store_si128(line + 2, colors);
+		_mm_store_si128(line + 3, colors);
+	}
+#endif
+
+	for (; i < count; i++) {
+		destination[i] = color;
+	}
+}
+
+void fullClear(uint32_t color) {
+	fillPixels(pixels.data, (size_t)x_res * y_res, color);
+	zBufferReset();
+
+	for (unsigned int i = 0; i < clear_tiles_x * clear_tiles_y; i++) {
+		drawn_tiles[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+void lazyClear(uint32_t color) {
+	for (unsigned int tile_y = 0; tile_y < clear_tiles_y; tile_y++) {
+		unsigned int min_y = tile_y << CLEAR_TILE_SHIFT;
+		unsigned int max_y = std::min(min_y + (1 << CLEAR_TILE_SHIFT), y_res);
+		std::atomic<unsigned char>* row_tiles = drawn_tiles + tile_y * clear_tiles_x;
+
+		for (unsigned int tile_x = 0; tile_x < clear_tiles_x; tile_x++) {
+			if (!row_tiles[tile_x].load(std::memory_order_relaxed)) {
+				continue;
+			}
+
+			// clear runs of neighboring tiles together
+			unsigned int run_end = tile_x;
+
+			while (
+					run_end < clear_tiles_x &&
+					row_tiles[run_end].load(std::memory_order_relaxed)) {
+				row_tiles[run_end].store(0, std::memory_order_relaxed);
+				run_end++;
+			}
+
+			unsigned int min_x = tile_x << CLEAR_TILE_SHIFT;
+			unsigned int width =
+					std::min(run_end << CLEAR_TILE_SHIFT, x_res) - min_x;
+
+			// the framebuffer is upside down compared to the z buffer, see setPixel()
+			for (unsigned int y = min_y; y < max_y; y++) {
+				fillPixels(
+						pixels.data + (size_t)(y_res - y - 1) * x_res + min_x,
+						width,
+						color);
+				memset(
+						zbuffer + (size_t)y * x_res + min_x,
+						0,
+						width * sizeof(device::depth_t));
+			}
+
+			tile_x = run_end;
+		}
+	}
+
+	hierarchicalZReset();
+}
+
+// when the render scale is below 1, updateScreen() upscales the framebuffer
+// into this before presenting it
+uint32_t* display_pixels = nullptr;
+
+// for each output column, the framebuffer column it samples when upscaling
+std::vector<unsigned int> upscale_columns;
+
+void freeFramebuffers() {
+	util::alignedFree(pixels.data);
+	util::alignedFree(zbuffer);
+	util::alignedFree(display_pixels);
+	util::alignedFree(depth_tiles);
+	util::alignedFree(depth_tile_rows);
+	delete[] drawn_tiles;
+
+	pixels.data = nullptr;
+	zbuffer = nullptr;
+	display_pixels = nullptr;
+	depth_tiles = nullptr;
+	depth_tile_rows = nullptr;
+	drawn_tiles = nullptr;
+}
+
+// returns false if any of them couldn't be allocated, with none left allocated
+bool allocateFramebuffers() {
+	size_t pixel_count = (size_t)output_x_res * output_y_res;
+
+	pixels.data = (uint32_t*)util::alignedAlloc(
+			util::kCacheLineSize, pixel_count * sizeof(uint32_t));
+	zbuffer = (device::depth_t*)util::alignedAlloc(
+			util::kCacheLineSize, pixel_count * sizeof(device::depth_t));
+	display_pixels = (uint32_t*)util::alignedAlloc(
+			util::kCacheLineSize, pixel_count * sizeof(uint32_t));
+
+	size_t tile_count =
+			depthTileCount(output_x_res) * depthTileCount(output_y_res);
+
+	depth_tiles = (device::depth_t*)util::alignedAlloc(
+			util::kCacheLineSize, tile_count * sizeof(device::depth_t));
+	depth_tile_rows = (device::depth_t*)util::alignedAlloc(
+			util::kCacheLineSize,
+			tile_count * device::kDepthTileSize * sizeof(device::depth_t));
+
+	drawn_tiles = new std::atomic<unsigned char>[
+			clearTileCount(output_x_res) * clearTileCount(output_y_res)]();
+	needs_full_clear = true;
+
+	if (!pixels.data || !zbuffer || !display_pixels || !depth_tiles || !depth_tile_rows) {
+		freeFramebuffers();
+		return false;
+	}
+
+	return true;
+}
+
+// nearest neighbor upscale of the framebuffer to the output resolution
+void upscaleFramebuffer() {
+	const uint32_t* previous_source_row = nullptr;
+	uint32_t* previous_output_row = nullptr;
+
+	for (unsigned int y = 0; y < output_y_res; ++y) {
+		const uint32_t* source_row =
+				pixels.data + (size_t)(y * y_res / output_y_res) * x_res;
+		uint32_t* output_row = display_pixels + (size_t)y * output_x_res;
+
+		if (source_row == previous_source_row) {
+			memcpy(output_row, previous_output_row, output_x_res * sizeof(uint32_t));
+		} else {
+			for (unsigned int x = 0; x < output_x_res; ++x) {
+				output_row[x] = source_row[upscale_columns[x]];
+			}
+		}
+
+		previous_source_row = source_row;
+		previous_output_row = output_row;
+	}
+}
+
+#if DEVICE_HEADLESS
+int headless_frame_count = 0;
+#else
 SDL_Window* window;
 SDL_Renderer* renderer;
 SDL_Texture* texture;
 SDL_Event event;
+#endif
 
 bool is_running = false;
 
@@ -89,10 +357,26 @@ namespace device {
 	// device management
 	// ***************************************************************************
 
-	bool setUp() {
+	bool setUp(unsigned int x_resolution, unsigned int y_resolution) {
 		util::initRandom();
+
+		output_x_res = x_resolution;
+		output_y_res = y_resolution;
+		if (!allocateFramebuffers()) {
+			printf("Unable to allocate the framebuffers\n");
+			return false;
+		}
+
+		setRenderScale(1.0);
+
 		clearScreen(DEFAULT_BACKGROUND_COLOR);
 
+#if DEVICE_HEADLESS
+		headless_frame_count = 0;
+		is_running = true;
+
+		printf("Headless device setup successful!\n");
+#else
 		if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS) != 0) {
 			SDL_Log("Unable to initialize SDL: %s", SDL_GetError());
 			return false;
@@ -104,8 +388,8 @@ namespace device {
 				"buffdog",
 				SDL_WINDOWPOS_UNDEFINED,
 				SDL_WINDOWPOS_UNDEFINED,
-				RES_X,
-				RES_Y,
+				output_x_res,
+				output_y_res,
 				SDL_WINDOW_SHOWN);
 
 		if (window == nullptr) {
@@ -128,8 +412,8 @@ namespace device {
 				renderer,
 				SDL_PIXELFORMAT_RGBX8888,
 				SDL_TEXTUREACCESS_STATIC,
-				RES_X,
-				RES_Y);
+				output_x_res,
+				output_y_res);
 
 		if (texture == nullptr) {
 			SDL_Log("Unable to create SDL texture: %s", SDL_GetError());
@@ -168,6 +452,7 @@ namespace device {
 		}
 
 		SDL_Log("Device setup successful!");
+#endif
 
 		last_fps_print_time = std::chrono::steady_clock::now();
 
@@ -175,10 +460,14 @@ namespace device {
 	}
 
 	void tearDown() {
+#if !DEVICE_HEADLESS
 		SDL_DestroyWindow(window);
 		SDL_DestroyRenderer(renderer);
 		SDL_DestroyTexture(texture);
 		SDL_Quit();
+#endif
+
+		freeFramebuffers();
 	}
 
 	void selfDestruct(char const* message, int line_number, const char* file_name) {
@@ -192,13 +481,17 @@ namespace device {
 	}
 
 	void clearScreen(int color) {
-		zBufferReset();
-
-		for (int y = 0; y < RES_Y; ++y) {
-			for (int x = 0; x < RES_X; ++x) {
-				setPixel(x, y, color);
-			}
+#if LAZY_CLEAR
+		if (!needs_full_clear && (uint32_t)color == last_clear_color) {
+			lazyClear(color);
+			return;
 		}
+#endif
+
+		fullClear(color);
+
+		needs_full_clear = false;
+		last_clear_color = color;
 	}
 
 #define DEBUG_CHECK_OOB 0
@@ -207,7 +500,7 @@ namespace device {
 
 	void setPixel(int x, int y, int color) {
 #if DEBUG_CHECK_OOB
-		if (x < 0 || y < 0 || x >= RES_X || y >= RES_Y) {
+		if (x < 0 || y < 0 || x >= (int)x_res || y >= (int)y_res) {
 			char message[1024];
 			snprintf(
 					message,
@@ -215,8 +508,8 @@ namespace device {
 					"trying to draw a pixel at x=%d and y=%d which is crazy illegal!!! resolution is %d x %d\n",
 					x,
 					y,
-					RES_X,
-					RES_Y);
+					x_res,
+					y_res);
 
 	#if DEBUG_FATAL_OOB
 			terminateFatal(message);
@@ -229,23 +522,60 @@ namespace device {
 		}
 #endif
 
+#if LAZY_CLEAR
+		drawn_tiles[(y >> CLEAR_TILE_SHIFT) * clear_tiles_x + (x >> CLEAR_TILE_SHIFT)]
+				.store(1, std::memory_order_relaxed);
+#endif
+
 		// invert y since it starts at the top
-		y = RES_Y - y - 1;
-		size_t index = y * RES_X + x;
+		y = y_res - y - 1;
+		size_t index = y * x_res + x;
 
 		pixels.data[index] = color;
 	}
 
 	void updateScreen() {
+#if DEVICE_HEADLESS
+		if (
+				HEADLESS_DUMP_INTERVAL > 0 &&
+				headless_frame_count % HEADLESS_DUMP_INTERVAL == 0) {
+			char filename[256];
+			snprintf(
+					filename,
+					sizeof(filename),
+					HEADLESS_DUMP_FORMAT,
+					headless_frame_count);
+
+			if (!dumpFrame(filename)) {
+				printf("couldn't dump frame to %s\n", filename);
+			}
+		}
+
+		headless_frame_count += 1;
+
+		if (
+				HEADLESS_FRAME_LIMIT > 0 &&
+				headless_frame_count >= HEADLESS_FRAME_LIMIT) {
+			is_running = false;
+		}
+#else
+		uint32_t* presented_pixels = pixels.data;
+
+		if (x_res != output_x_res || y_res != output_y_res) {
+			upscaleFramebuffer();
+			presented_pixels = display_pixels;
+		}
+
 		SDL_UpdateTexture(
 				texture,
 				nullptr,
-				pixels.data,
-				RES_X * sizeof(uint32_t));
+				presented_pixels,
+				output_x_res * sizeof(uint32_t));
 
 		SDL_RenderClear(renderer);
 		SDL_RenderCopy(renderer, texture, nullptr, nullptr);
 		SDL_RenderPresent(renderer);
+#endif
 
 		logFPS();
 
@@ -255,6 +585,40 @@ namespace device {
 #endif
 	}
 
+	const uint32_t* getFramebuffer() {
+		return pixels.data;
+	}
+
+	bool dumpFrame(const char* filename) {
+		FILE* file = fopen(filename, "wb");
+
+		if (!file) {
+			return false;
+		}
+
+		fprintf(file, "P6\n%d %d\n255\n", x_res, y_res);
+
+		// the framebuffer is already stored top row first, and each pixel is
+		// RGBX with red in the most significant byte
+		std::vector<unsigned char> row(x_res * 3);
+
+		for (unsigned int y = 0; y < y_res; ++y) {
+			for (unsigned int x = 0; x < x_res; ++x) {
+				uint32_t color = pixels.data[y * x_res + x];
+
+				row[x * 3] = (color >> 24) & 0xff;
+				row[x * 3 + 1] = (color >> 16) & 0xff;
+				row[x * 3 + 2] = (color >> 8) & 0xff;
+			}
+
+			fwrite(row.data(), 1, row.size(), file);
+		}
+
+		fclose(file);
+
+		return true;
+	}
+
 	// ***************************************************************************
 	// IO
 	// ***************************************************************************
@@ -265,6 +629,7 @@ namespace device {
 		input_state.mouse.motion_x = 0;
 		input_state.mouse.motion_y = 0;
 
+#if !DEVICE_HEADLESS
 		while (SDL_PollEvent(&event)) {
 			switch(event.type) {
 				case SDL_QUIT:
@@ -404,6 +769,7 @@ namespace device {
 				break;
 			}
 		}
+#endif
 	}
 
 	InputState* getInputState() {
@@ -427,18 +793,87 @@ namespace device {
 		return (red_value << 24) + (green_value << 16) + (blue_value << 8);
 	}
 
-	double& zBufferAt(size_t x, size_t y) {
-		size_t index = y * RES_X + x;
+	depth_t& zBufferAt(size_t x, size_t y) {
+		size_t index = y * x_res + x;
 
 		return zbuffer[index];
 	}
 
+	depth_t tileFarthestDepth(int tile_x, int tile_y) {
+		return depth_tiles[tile_y * depth_tiles_x + tile_x];
+	}
+
+	void raiseDepthTileRow(int tile_x, int y, depth_t depth) {
+		depth_t& row = depth_tile_rows[y * depth_tiles_x + tile_x];
+
+		if (depth <= row) {
+			return;
+		}
+
+		row = depth;
+
+		// the tile is as far as its farthest row
+		int first_row = y & ~(kDepthTileSize - 1);
+		depth_t farthest = depth;
+
+		for (int i = 0; i < kDepthTileSize; i++) {
+			depth_t row_depth =
+					depth_tile_rows[(first_row + i) * depth_tiles_x + tile_x];
+
+			if (row_depth < farthest) {
+				farthest = row_depth;
+			}
+		}
+
+		depth_tiles[(y >> kDepthTileShift) * depth_tiles_x + tile_x] = farthest;
+	}
+
 	unsigned int getXRes() {
-		return RES_X;
+		return x_res;
 	}
 
 	unsigned int getYRes() {
-		return RES_Y;
+		return y_res;
+	}
+
+	void setRenderScale(double scale) {
+		if (scale > 1.0) {
+			scale = 1.0;
+		} else if (scale < MIN_RENDER_SCALE) {
+			scale = MIN_RENDER_SCALE;
+		}
+
+		render_scale = scale;
+		x_res = output_x_res * scale;
+		y_res = output_y_res * scale;
+
+		if (x_res < 1) {
+			x_res = 1;
+		}
+
+		if (y_res < 1) {
+			y_res = 1;
+		}
+
+		pixels.bytes_per_line = x_res * sizeof(uint32_t);
+
+		depth_tiles_x = depthTileCount(x_res);
+		depth_tiles_y = depthTileCount(y_res);
+
+		// the framebuffer's layout just changed
+		clear_tiles_x = clearTileCount(x_res);
+		clear_tiles_y = clearTileCount(y_res);
+		needs_full_clear = true;
+
+		upscale_columns.resize(output_x_res);
+
+		for (unsigned int x = 0; x < output_x_res; ++x) {
+			upscale_columns[x] = x * x_res / output_x_res;
+		}
+	}
+
+	double getRenderScale() {
+		return render_scale;
 	}
 
 	// this is here because I was using this with drawPoint and the mouse, and
@@ -450,8 +885,8 @@ namespace device {
 		return
 				x > VIEWPORT_BUFFER &&
 				y > VIEWPORT_BUFFER &&
-				x < RES_X - VIEWPORT_BUFFER &&
-				y < RES_Y - VIEWPORT_BUFFER;
+				x < (int)x_res - VIEWPORT_BUFFER &&
+				y < (int)y_res - VIEWPORT_BUFFER;
 	}
 
 	void logFPS() {
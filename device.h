@@ -20,6 +20,17 @@ constexpr double kTau = kPi * 2;
 
 #define terminateFatal(message) device::selfDestruct(message, __LINE__, __FILE__)
 
+// z buffer formats, pick one with DEPTH_FORMAT
+// smaller formats use less memory bandwidth for clearing and depth testing, at
+// the cost of precision far from the camera
+#define DEPTH_FORMAT_DOUBLE 0
+#define DEPTH_FORMAT_FLOAT 1
+#define DEPTH_FORMAT_UINT16 2
+
+#ifndef DEPTH_FORMAT
+#define DEPTH_FORMAT DEPTH_FORMAT_FLOAT
+#endif
+
 
 typedef enum {
 	no_key,
@@ -34,13 +45,50 @@ typedef enum {
 
 
 namespace device {
+	// fixed 4:3 aspect ratio by default (see also Scene::init())
+	constexpr unsigned int kDefaultXRes = 1024;
+	constexpr unsigned int kDefaultYRes = kDefaultXRes / 4 * 3;
+
+	// The z buffer stores reversed depth, -1/z (z is always negative in camera
+	// space).  0 is infinitely far away, so clearing is a memset, and larger
+	// values are closer.  Since 1/z is linear in screen space, it can be
+	// interpolated directly across triangles.
+#if DEPTH_FORMAT == DEPTH_FORMAT_DOUBLE
+	typedef double depth_t;
+#elif DEPTH_FORMAT == DEPTH_FORMAT_FLOAT
+	typedef float depth_t;
+#elif DEPTH_FORMAT == DEPTH_FORMAT_UINT16
+	typedef uint16_t depth_t;
+
+	// -1/z is 10 at the near plane (see Scene::init()), so this maps the near
+	// plane to the largest 16 bit value
+	constexpr double kUint16DepthScale = 65535.0 / 10.0;
+#else
+#error "unknown DEPTH_FORMAT"
+#endif
+
+	// converts an interpolated 1/z value into the z buffer's format
+	inline depth_t depthFromInvZ(double inv_z) {
+#if DEPTH_FORMAT == DEPTH_FORMAT_UINT16
+		double depth = -inv_z * kUint16DepthScale;
+
+		return depth < 65535.0 ? (depth_t)depth : 65535;
+#else
+		return (depth_t)-inv_z;
+#endif
+	}
+
 	// ***************************************************************************
 	// device management
 	// ***************************************************************************
 
 	// This must be called first
+	// the resolution is that of the window, see setRenderScale() for the
+	// resolution that is actually rendered
 	// returns false on failure
-	bool setUp();
+	bool setUp(
+			unsigned int x_resolution = kDefaultXRes,
+			unsigned int y_resolution = kDefaultYRes);
 
 	// Should be called before exiting the program
 	void tearDown();
@@ -61,6 +109,13 @@ namespace device {
 	// call after drawing the background and all desired pixels
 	void updateScreen();
 
+	// writes the current contents of the framebuffer to a binary PPM file
+	// returns false on failure
+	bool dumpFrame(const char* filename);
+
+	// the framebuffer's getXRes() * getYRes() pixels, top row first
+	const uint32_t* getFramebuffer();
+
 	// ***************************************************************************
 	// input
 	// ***************************************************************************
@@ -83,12 +138,37 @@ namespace device {
 	// red, green, and blue must be between 0.0 and 1.0
 	uint32_t getColorValue(double red, double green, double blue);
 
-	// get/set z buffer value for pixel
-	double& zBufferAt(size_t x, size_t y);
+	// get/set z buffer value for pixel, see depthFromInvZ()
+	depth_t& zBufferAt(size_t x, size_t y);
+
+	// The hierarchical z buffer keeps the farthest depth of each square tile of
+	// the z buffer, so anything that isn't nearer than that can be rejected for
+	// the entire tile without touching the z buffer itself.
+	// It's never read back from the z buffer.  Instead, rasterizers report
+	// whenever they've depth tested every pixel of one row of a tile with
+	// raiseDepthTileRow(), which all of Triangle2D's fills do.  Rows that are
+	// only partly covered by each triangle never raise the tile, so a tile only
+	// becomes useful once single triangles have covered each of its rows.
+	constexpr int kDepthTileShift = 3;
+	constexpr int kDepthTileSize = 1 << kDepthTileShift;
 
+	depth_t tileFarthestDepth(int tile_x, int tile_y);
+
+	// call after depth testing all of the pixels on row y of the tile, where
+	// depth is the farthest value that was tested
+	void raiseDepthTileRow(int tile_x, int y, depth_t depth);
+
+	// the internal resolution that everything is drawn at
 	unsigned int getXRes();
 	unsigned int getYRes();
 
+	// render at a fraction (between 0.1 and 1.0) of the window's resolution,
+	// the framebuffer is upscaled to fill the window in updateScreen()
+	// can be changed between frames, e.g. to lower the resolution when frame
+	// times spike
+	void setRenderScale(double scale);
+	double getRenderScale();
+
 	bool insideViewport(int x, int y);
 
 	// logs FPS once per second
@@ -2,6 +2,7 @@
 #define BUFFDOG_LIBDT
 
 #include <array>
+#include <climits>
 #include <cstdlib>
 #include <list>
 #include <map>
@@ -6,6 +6,156 @@
 
 typedef enum {x_axis, y_axis, z_axis, w_axis} axis;
 
+#define ROTATION_EPSILON 0.00001 * 0.00001 * 0.00001
+
+// both at once, which is one call instead of two where the C library has
+// sincos(), and with values too small to matter rounded to 0, so that e.g. a
+// quarter turn doesn't leave a tiny cosine behind
+inline void sinCos(double angle, double& s, double& c) {
+#if defined(__GLIBC__)
+	sincos(angle, &s, &c);
+#else
+	s = sin(angle);
+	c = cos(angle);
+#endif
+
+	if (double abs_s = fabs(s); abs_s > 0 && abs_s < ROTATION_EPSILON) {
+		s = 0;
+	}
+
+	if (double abs_c = fabs(c); abs_c > 0 && abs_c < ROTATION_EPSILON) {
+		c = 0;
+	}
+}
+
+
+struct Matrix;
+
+// A Matrix whose last row is 0 0 0 1, which rotations, scales, translations
+// and any product of them are, so only the first three rows are kept.  Points
+// and directions go through it with 9 multiplies instead of 16, and products
+// of them are built directly instead of by multiplying 4x4 matrices, e.g.
+// world() is a rotation scaled and moved in one go.
+// The rows are worked out in the same order as the Matrix products they
+// replace, so they give exactly the same results.
+struct AffineTransform {
+	// [row][column]
+	double data[3][4];
+
+	constexpr double at(size_t row, size_t col) const {
+		return data[row][col];
+	}
+
+	constexpr Vector transformPoint(const Vector& point) const {
+		return Vector{
+			data[0][0] * point.x + data[0][1] * point.y + data[0][2] * point.z + data[0][3],
+			data[1][0] * point.x + data[1][1] * point.y + data[1][2] * point.z + data[1][3],
+			data[2][0] * point.x + data[2][1] * point.y + data[2][2] * point.z + data[2][3],
+			point.w
+		};
+	}
+
+	// directions aren't moved by the translation
+	constexpr Vector transformDirection(const Vector& direction) const {
+		return Vector{
+			data[0][0] * direction.x + data[0][1] * direction.y + data[0][2] * direction.z,
+			data[1][0] * direction.x + data[1][1] * direction.y + data[1][2] * direction.z,
+			data[2][0] * direction.x + data[2][1] * direction.y + data[2][2] * direction.z,
+			direction.w
+		};
+	}
+
+	// points (w = 1) are moved, and directions (w = 0) aren't
+	constexpr Vector transform(const Vector& vector) const {
+		return vector.w == 0 ? transformDirection(vector) : transformPoint(vector);
+	}
+
+	// this * other, i.e. other then this, like Matrix::multiplyMatrix()
+	constexpr AffineTransform multiplyTransform(const AffineTransform& other) const {
+		AffineTransform result = {};
+
+		for (int i = 0; i < 3; i++) {
+			for (int j = 0; j < 4; j++) {
+				result.data[i][j] =
+						data[i][0] * other.data[0][j]
+						+ data[i][1] * other.data[1][j]
+						+ data[i][2] * other.data[2][j];
+			}
+
+			result.data[i][3] += data[i][3];
+		}
+
+		return result;
+	}
+
+	Matrix toMatrix() const;
+
+	static constexpr AffineTransform identity() {
+		return AffineTransform{{
+			{1, 0, 0, 0},
+			{0, 1, 0, 0},
+			{0, 0, 1, 0}
+		}};
+	}
+
+	// the same as rotating about x, then y, then z, each by minus rotation's
+	// component, see Matrix::makeAxisRotationMatrix()
+	static AffineTransform rotation(Vector rotation) {
+		double sx, cx, sy, cy, sz, cz;
+		sinCos(rotation.x * -1, sx, cx);
+		sinCos(rotation.y * -1, sy, cy);
+		sinCos(rotation.z * -1, sz, cz);
+
+		// y times x, then z times that
+		double sysx = sy * sx;
+		double sycx = sy * cx;
+
+		return AffineTransform{{
+			{cz * cy, cz * sysx - sz * cx, cz * sycx + sz * sx, 0},
+			{sz * cy, sz * sysx + cz * cx, sz * sycx - cz * sx, 0},
+			{-sy, cy * sx, cy * cx, 0}
+		}};
+	}
+
+	// scaled, then rotated, then moved, from a rotation that's already been
+	// built, so that it can also be used for normals
+	static constexpr AffineTransform world(
+			double scale, const AffineTransform& rotation, Vector translation) {
+		const double (&r)[3][4] = rotation.data;
+
+		return AffineTransform{{
+			{scale * r[0][0], scale * r[0][1], scale * r[0][2], translation.x},
+			{scale * r[1][0], scale * r[1][1], scale * r[1][2], translation.y},
+			{scale * r[2][0], scale * r[2][1], scale * r[2][2], translation.z}
+		}};
+	}
+
+	static AffineTransform world(double scale, Vector rotation, Vector translation) {
+		return world(scale, AffineTransform::rotation(rotation), translation);
+	}
+
+	// moves the camera to the origin, then turns the opposite way to it, so
+	// the rotation is transposed (its inverse) and applied to minus position
+	// the camera can't roll, so rotation.z is ignored
+	static AffineTransform camera(Vector rotation, Vector position) {
+		AffineTransform r = AffineTransform::rotation(Vector::direction(rotation.x, rotation.y, 0));
+		AffineTransform result = {};
+
+		for (int i = 0; i < 3; i++) {
+			for (int j = 0; j < 3; j++) {
+				result.data[i][j] = r.data[j][i];
+			}
+
+			result.data[i][3] =
+					r.data[0][i] * -position.x
+					+ r.data[1][i] * -position.y
+					+ r.data[2][i] * -position.z;
+		}
+
+		return result;
+	}
+};
+
 
 struct Matrix {
 	// [row][column]
@@ -15,7 +165,11 @@ struct Matrix {
 		return data[row][col];
 	}
 
-	Matrix transpose() {
+	double at(size_t row, size_t col) const {
+		return data[row][col];
+	}
+
+	Matrix transpose() const {
 		Matrix result;
 
 		for (int i = 0; i < 4; i++) {
@@ -27,34 +181,44 @@ struct Matrix {
 		return result;
 	}
 
-	Matrix multiplyMatrix(Matrix other) {
+	Matrix multiplyMatrix(const Matrix& other) const {
 		Matrix result;
 
-		double calc;
-
 		for (int i = 0; i < 4; i++) {
 			for (int j = 0; j < 4; j++) {
-			 	calc = 0;
-
-				for (int k = 0; k < 4; k++) {
-					calc += this->at(i, k) * other.at(k, j);
-				}
-
-				result.at(i, j) = calc;
+				result.data[i][j] =
+						this->data[i][0] * other.data[0][j]
+						+ this->data[i][1] * other.data[1][j]
+						+ this->data[i][2] * other.data[2][j]
+						+ this->data[i][3] * other.data[3][j];
 			}
 		}
 
 		return result;
 	}
 
-	Vector multiplyVector(Vector vec) {
+	Vector multiplyVector(const Vector& vec) const {
 		Vector result;
+		double* rows[4] = {&result.x, &result.y, &result.z, &result.w};
 
 		for (int i = 0; i < 4; i++) {
-			result.at(i) = 0;
+			*rows[i] =
+					this->data[i][0] * vec.x
+					+ this->data[i][1] * vec.y
+					+ this->data[i][2] * vec.z
+					+ this->data[i][3] * vec.w;
+		}
+
+		return result;
+	}
+
+	// the top three rows, for matrices that are known to be affine
+	AffineTransform toAffine() const {
+		AffineTransform result;
 
+		for (int i = 0; i < 3; i++) {
 			for (int j = 0; j < 4; j++) {
-				result.at(i) += this->at(i, j) * vec.at(j);
+				result.data[i][j] = this->data[i][j];
 			}
 		}
 
@@ -87,19 +251,9 @@ struct Matrix {
 		return result;
 	}
 
-	#define ROTATION_EPSILON 0.00001 * 0.00001 * 0.00001
-
 	static Matrix makeAxisRotationMatrix(double angle, axis about_axis) {
-		double s = sin(angle);
-		double c = cos(angle);
-
-		if (double abs_s = fabs(s); abs_s > 0 && abs_s < ROTATION_EPSILON) {
-			s = 0;
-		}
-
-		if (double abs_c = fabs(c); abs_c > 0 && abs_c < ROTATION_EPSILON) {
-			c = 0;
-		}
+		double s, c;
+		sinCos(angle, s, c);
 
 		Matrix r;
 
@@ -126,45 +280,7 @@ struct Matrix {
 	}
 
 	static Matrix makeRotationMatrix(Vector rotation) {
-#if 1
-		Matrix xRotation = makeAxisRotationMatrix(rotation.x * -1, x_axis);
-		Matrix yRotation = makeAxisRotationMatrix(rotation.y * -1, y_axis);
-		Matrix zRotation = makeAxisRotationMatrix(rotation.z * -1, z_axis);
-
-		return zRotation.multiplyMatrix(yRotation.multiplyMatrix(xRotation));
-#else
-		double alpha = rotation.z * -1;
-		double beta = rotation.y * -1;
-		double gamma = rotation.x * -1;
-
-		double sa = sin(alpha), ca = cos(alpha);
-		double sb = sin(beta),  cb = cos(beta);
-		double sg = sin(gamma), cg = cos(gamma);
-
-		Matrix result;
-
-		result.at(0, 0) = ca * cb;
-		result.at(0, 1) = ca * sb * sg - (sa * cg);
-		result.at(0, 2) = ca * sb * cg + sa * sg;
-		result.at(0, 3) = 0;
-
-		result.at(1, 0) = sa * cb;
-		result.at(1, 1) = sa * sb * sg + ca * cg;
-		result.at(1, 2) = sa * sb * cg - (ca * sg);
-		result.at(1, 3) = 0;
-
-		result.at(2, 0) = sb * -1;
-		result.at(2, 1) = cb * sg;
-		result.at(2, 2) = cb * cg;
-		result.at(2, 3) = 0;
-
-		result.at(3, 0) = 0;
-		result.at(3, 1) = 0;
-		result.at(3, 2) = 0;
-		result.at(3, 3) = 1;
-
-		return result;
-#endif
+		return AffineTransform::rotation(rotation).toMatrix();
 	}
 
 	static Matrix makeTranslationMatrix(Vector translation) {
@@ -194,24 +310,11 @@ struct Matrix {
 	}
 
 	static Matrix makeWorldMatrix(double scale, Vector rotation, Vector translation) {
-		Matrix scaleMat = makeScaleMatrix(scale);
-		Matrix rotationMat = makeRotationMatrix(rotation);
-		Matrix translationMat = makeTranslationMatrix(translation);
-
-		return translationMat.multiplyMatrix(scaleMat).multiplyMatrix(rotationMat);
+		return AffineTransform::world(scale, rotation, translation).toMatrix();
 	}
 
 	static Matrix makeCameraMatrix(Vector rotation, Vector translation) {
-		Vector safeRotation = Vector::direction(rotation.x, rotation.y, 0);
-		Vector invertedTranslation = Vector::direction(
-				-translation.x,
-				-translation.y,
-				-translation.z);
-
-		Matrix rotationMat = makeRotationMatrix(safeRotation).transpose();
-		Matrix translationMat = makeTranslationMatrix(invertedTranslation);
-
-		return rotationMat.multiplyMatrix(translationMat);
+		return AffineTransform::camera(rotation, translation).toMatrix();
 	}
 
 	void log() {
@@ -249,4 +352,21 @@ struct Matrix {
 	}
 };
 
+inline Matrix AffineTransform::toMatrix() const {
+	Matrix result;
+
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 4; j++) {
+			result.data[i][j] = this->data[i][j];
+		}
+	}
+
+	result.data[3][0] = 0;
+	result.data[3][1] = 0;
+	result.data[3][2] = 0;
+	result.data[3][3] = 1;
+
+	return result;
+}
+
 #endif
@@ -0,0 +1,1222 @@
+// Headless renderer benchmarks, see the bench targets in the Makefile.
+// Run all of them with `./bench`, or just some with e.g. `./bench frame`.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../device.h"
+#include "../vector.h"
+
+#include "bmp.h"
+#include "entity.h"
+#include "level.h"
+#include "mesh.h"
+#include "mesh_optimizer.h"
+#include "model.h"
+#include "obj.h"
+#include "renderer.h"
+#include "scene.h"
+
+
+const char* crate_texture_file = "assets/textures/crate.bmp";
+const char* basic_level_file = "assets/basic.level";
+const char* city_model_file = "assets/models/city.obj";
+const char* teapot_model_file = "assets/models/teapot.obj";
+
+#define BENCH_FRAMES 200
+#define BENCH_VIEWS 4
+#define BENCH_CLEARS 500
+#define BENCH_CLIP_VIEWS 32
+#define BENCH_CLIP_PASSES 500
+#define BENCH_CULL_TEAPOTS 64
+
+// the generated OBJ file is a grid of this many quads on each side
+#define BENCH_OBJ_GRID 1000
+const char* bench_obj_file = "bench_grid.obj";
+const char* bench_mesh_file = "bench_grid.mesh";
+
+// the reorder benchmark draws a generated grid of this many quads on each
+// side, this many times, with its triangles shuffled and then optimized
+#define BENCH_REORDER_GRID 200
+#define BENCH_REORDER_PASSES 20
+
+// the transform benchmark moves this many points into camera space this many
+// times, and fails if the float results are further than this from the
+// double ones
+#define BENCH_TRANSFORM_POINTS 1000000
+#define BENCH_TRANSFORM_PASSES 20
+#define BENCH_TRANSFORM_MAX_ERROR 1e-4
+
+// the matrix benchmark sets up this many entities' transforms
+#define BENCH_MATRIX_ENTITIES 100000
+
+// the perspective benchmark fails if spans up to this long are off from exact
+// perspective by more than this much per color channel on average
+#define PERSPECTIVE_CHECKED_SPAN 16
+#define PERSPECTIVE_MAX_MEAN_ERROR 0.25
+
+#if DEPTH_FORMAT == DEPTH_FORMAT_DOUBLE
+const char* depth_format_name = "double";
+#elif DEPTH_FORMAT == DEPTH_FORMAT_FLOAT
+const char* depth_format_name = "float";
+#else
+const char* depth_format_name = "uint16";
+#endif
+
+
+typedef std::chrono::steady_clock bench_clock;
+
+double millisecondsSince(bench_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(
+			bench_clock::now() - start).count();
+}
+
+bool shouldRun(int argc, char** argv, const char* name) {
+	if (argc < 2) {
+		return true;
+	}
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], name) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+// everything the benchmark scene points to has to outlive it
+struct BenchWorld {
+	LevelData level;
+	BMPTexture crate_texture;
+	Model crate_model;
+	std::list<Model> platform_models;
+	Scene scene;
+};
+
+void addStaticEntity(Scene& scene, Model* model, Vector position) {
+	Entity entity;
+	entity.model = model;
+	entity.position = position;
+	entity.is_static = true;
+	entity.scene = &scene;
+	entity.buildWorldModel();
+
+	scene.entities.push_back(std::move(entity));
+}
+
+// the basic level's platforms, plus rows of crates in front of the camera so
+// that there's plenty of overdraw
+void setUpBenchWorld(BenchWorld& world) {
+	world.level = loadLevelFromFile(basic_level_file);
+
+	if (!world.level.valid) {
+		terminateFatal("couldn't load level");
+	}
+
+	world.crate_texture = BMPTexture::load(crate_texture_file);
+	world.crate_model = Model::buildCube();
+	world.crate_model.setTexture(&world.crate_texture);
+
+	Scene& scene = world.scene;
+	scene.init(Player());
+
+	for (auto& platform : world.level.platforms) {
+		world.platform_models.push_back(
+				Model::buildHexahedron(platform.start_pos, platform.end_pos));
+		addStaticEntity(scene, &world.platform_models.back(), Vector::origin());
+	}
+
+	for (int row = 0; row < 6; row++) {
+		for (int column = -3; column <= 3; column++) {
+			addStaticEntity(
+					scene,
+					&world.crate_model,
+					Vector::point(column * 2.5, 1.5 + (row % 2), -6 - row * 4));
+		}
+	}
+
+	scene.camera.position = world.level.fighters[0].position;
+	scene.camera.position.y += world.level.fighter_eye_height;
+}
+
+// the renderer's options that the benchmarks try different values of, saved
+// beforehand so that each benchmark can put back whatever it found, rather
+// than what the defaults happen to be
+struct RendererSettings {
+	FillMethod fill_method;
+	int perspective_span;
+	bool guard_band;
+	bool cull_models;
+	bool sort_models;
+	bool use_span_buffer;
+	bool cache_static_lighting;
+
+	static RendererSettings save(const Renderer& renderer) {
+		RendererSettings settings;
+		settings.fill_method = renderer.fill_method;
+		settings.perspective_span = renderer.perspective_span;
+		settings.guard_band = renderer.guard_band;
+		settings.cull_models = renderer.cull_models;
+		settings.sort_models = renderer.sort_models;
+		settings.use_span_buffer = renderer.use_span_buffer;
+		settings.cache_static_lighting = renderer.cache_static_lighting;
+
+		return settings;
+	}
+
+	void restore(Renderer& renderer) const {
+		renderer.fill_method = this->fill_method;
+		renderer.perspective_span = this->perspective_span;
+		renderer.guard_band = this->guard_band;
+		renderer.cull_models = this->cull_models;
+		renderer.sort_models = this->sort_models;
+		renderer.use_span_buffer = this->use_span_buffer;
+		renderer.cache_static_lighting = this->cache_static_lighting;
+	}
+};
+
+// the way device::clearScreen() used to clear the framebuffer, for comparison
+void clearScreenPerPixel(int color) {
+	for (unsigned int y = 0; y < device::getYRes(); ++y) {
+		for (unsigned int x = 0; x < device::getXRes(); ++x) {
+			device::setPixel(x, y, color);
+		}
+	}
+}
+
+// times BENCH_CLEARS calls of clear, each after an untimed call of prepare,
+// then prints the average
+template <typename Prepare, typename Clear>
+void benchClear(const char* name, Prepare prepare, Clear clear) {
+	double total = 0;
+
+	for (int i = 0; i < BENCH_CLEARS; i++) {
+		prepare();
+
+		auto start = bench_clock::now();
+		clear(i);
+		total += millisecondsSince(start);
+	}
+
+	printf("clear: %.3f ms per clear (%s)\n", total / BENCH_CLEARS, name);
+}
+
+// how far one frame is from another, per color channel
+struct ImageDiff {
+	int max_error = 0;
+	double mean_error = 0;
+	double differing_pixels = 0; // fraction of them
+};
+
+ImageDiff diffFrames(const std::vector<uint32_t>& expected, const uint32_t* actual) {
+	ImageDiff diff;
+	size_t differing = 0;
+	double total_error = 0;
+
+	for (size_t i = 0; i < expected.size(); i++) {
+		if (expected[i] == actual[i]) {
+			continue;
+		}
+
+		differing++;
+
+		// colors are 0xRRGGBB00, see device::getColorValue()
+		for (int shift = 8; shift < 32; shift += 8) {
+			int error = abs(
+					(int)((expected[i] >> shift) & 0xff)
+					- (int)((actual[i] >> shift) & 0xff));
+
+			diff.max_error = error > diff.max_error ? error : diff.max_error;
+			total_error += error;
+		}
+	}
+
+	diff.mean_error = total_error / (expected.size() * 3);
+	diff.differing_pixels = (double)differing / expected.size();
+
+	return diff;
+}
+
+// how a pass over a model's triangles went in benchClipping()
+struct ClipStats {
+	double milliseconds = 0;
+	size_t inside = 0; // drawn without clipping
+	size_t rejected = 0; // entirely outside one plane
+	size_t clipped = 0;
+	size_t planes_clipped = 0; // the planes that clipped triangles were clipped against
+	size_t triangles = 0; // drawn, including the ones clipped polygons are split into
+};
+
+enum class ClipMode {
+	// any triangle with a vertex outside the frustum is clipped against all six
+	// planes, like it was before outcodes
+	all_planes,
+	outcodes,
+	guard_band
+};
+
+// the clipping part of Renderer::drawModel(), from the inside of model looking
+// in BENCH_CLIP_VIEWS directions, so that plenty of triangles cross the frustum
+ClipStats benchClipping(Renderer& renderer, Model& model, Vector eye, ClipMode mode) {
+	ClipStats stats;
+	std::vector<uint16_t> outcodes(model.vertices.size());
+	RendererSettings saved = RendererSettings::save(renderer);
+
+	renderer.guard_band = mode == ClipMode::guard_band;
+
+	for (int view = 0; view < BENCH_CLIP_VIEWS; view++) {
+		renderer.camera_matrix = AffineTransform::camera(
+				Vector::direction(view % 2 ? 0.4 : -0.4, kTau * view / BENCH_CLIP_VIEWS, 0),
+				eye);
+		renderer.transformToCamera(model);
+
+		VertexStream& vertices = renderer.camera_vertices;
+		auto start = bench_clock::now();
+
+		for (int pass = 0; pass < BENCH_CLIP_PASSES; pass++) {
+			bool count = pass == 0;
+
+			for (size_t i = 0; i < vertices.size(); i++) {
+				outcodes[i] = renderer.frustumOutcode(vertices.point(i));
+			}
+
+			for (auto& triangle : model.triangles) {
+				int outcode0 = outcodes[triangle.v0.index];
+				int outcode1 = outcodes[triangle.v1.index];
+				int outcode2 = outcodes[triangle.v2.index];
+				int planes = renderer.clipPlanes(outcode0 | outcode1 | outcode2);
+
+				if (mode != ClipMode::all_planes && (outcode0 & outcode1 & outcode2)) {
+					stats.rejected += count;
+					continue;
+				}
+
+				if (planes == 0) {
+					stats.inside += count;
+					stats.triangles += count;
+					continue;
+				}
+
+				if (mode == ClipMode::all_planes) {
+					planes = (1 << NUM_FRUSTUM_PLANES) - 1;
+				}
+
+				ClippedPolygon polygon = {
+						{
+							vertices.point(triangle.v0.index),
+							vertices.point(triangle.v1.index),
+							vertices.point(triangle.v2.index)
+						},
+						{1, 1, 1},
+						{0, 1, 0},
+						{0, 0, 1},
+						3};
+				ClippedPolygon scratch;
+				ClippedPolygon* result = renderer.clipTriangle(&polygon, &scratch, planes);
+
+				if (count) {
+					stats.clipped++;
+
+					for (int i = 0; i < NUM_CLIP_PLANES; i++) {
+						stats.planes_clipped += (planes >> i) & 1;
+					}
+
+					if (result->vertex_count > 2) {
+						stats.triangles += result->vertex_count - 2;
+					}
+				}
+			}
+		}
+
+		stats.milliseconds += millisecondsSince(start);
+	}
+
+	stats.milliseconds /= BENCH_CLIP_PASSES;
+	saved.restore(renderer);
+
+	return stats;
+}
+
+// writes a size x size grid of quads, every other one with negative indices,
+// or with each quad's corners written out again for it, the way exporters
+// that write a face at a time leave models
+void writeGridOBJ(const char* filename, int size, bool shared_corners = true) {
+	FILE* file = fopen(filename, "w");
+
+	if (!file) {
+		terminateFatal("couldn't write the benchmark obj file");
+	}
+
+	if (!shared_corners) {
+		fprintf(file, "vn 0.000000 1.000000 0.000000\n");
+
+		for (int z = 0; z < size; z++) {
+			for (int x = 0; x < size; x++) {
+				int corners[4][2] = {{x, z}, {x + 1, z}, {x + 1, z + 1}, {x, z + 1}};
+
+				for (auto& corner : corners) {
+					fprintf(
+							file,
+							"v %.6f %.6f %.6f\n",
+							corner[0] * 0.01,
+							0.05 * sin(corner[0] * 0.1 + corner[1] * 0.2),
+							corner[1] * -0.01);
+					fprintf(file, "vt %.6f %.6f\n", (double)corner[0] / size, (double)corner[1] / size);
+				}
+
+				fprintf(file, "f -4/-4/1 -3/-3/1 -2/-2/1 -1/-1/1\n");
+			}
+		}
+
+		fclose(file);
+		return;
+	}
+
+	int side = size + 1;
+	long vertex_count = (long)side * side;
+
+	for (int z = 0; z < side; z++) {
+		for (int x = 0; x < side; x++) {
+			fprintf(file, "v %.6f %.6f %.6f\n", x * 0.01, 0.05 * sin(x * 0.1 + z * 0.2), z * -0.01);
+			fprintf(file, "vt %.6f %.6f\n", (double)x / size, (double)z / size);
+		}
+	}
+
+	fprintf(file, "vn 0.000000 1.000000 0.000000\n");
+
+	for (int z = 0; z < size; z++) {
+		for (int x = 0; x < size; x++) {
+			long corners[4] = {
+					(long)z * side + x + 1,
+					(long)z * side + x + 2,
+					(long)(z + 1) * side + x + 2,
+					(long)(z + 1) * side + x + 1};
+
+			if ((x + z) % 2 == 1) {
+				for (auto& corner : corners) {
+					corner -= vertex_count + 1;
+				}
+			}
+
+			fprintf(
+					file,
+					"f %ld/%ld/1 %ld/%ld/1 %ld/%ld/1 %ld/%ld/1\n",
+					corners[0], corners[0],
+					corners[1], corners[1],
+					corners[2], corners[2],
+					corners[3], corners[3]);
+		}
+	}
+
+	fclose(file);
+}
+
+bool sameTriangles(const Model& a, const Model& b) {
+	if (a.triangles.size() != b.triangles.size() || a.vertices.size() != b.vertices.size()) {
+		return false;
+	}
+
+	for (size_t i = 0; i < a.triangles.size(); i++) {
+		const Triangle3D& first = a.triangles[i];
+		const Triangle3D& second = b.triangles[i];
+
+		if (first.v0.index != second.v0.index
+				|| first.v1.index != second.v1.index
+				|| first.v2.index != second.v2.index
+				|| first.v0.uv != second.v0.uv
+				|| first.v2.normal != second.v2.normal) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// each triangle's corners, in order, sorted, so models with the same
+// triangles in any order or numbering give the same list
+std::vector<std::array<double, 9> > sortedTriangleCorners(const Model& model) {
+	std::vector<std::array<double, 9> > result;
+
+	for (auto& triangle : model.triangles) {
+		std::array<double, 9> corners;
+		const Vertex* vertices[3] = {&triangle.v0, &triangle.v1, &triangle.v2};
+
+		for (int i = 0; i < 3; i++) {
+			const Vector& vertex = model.vertices[vertices[i]->index];
+			corners[3 * i] = vertex.x;
+			corners[3 * i + 1] = vertex.y;
+			corners[3 * i + 2] = vertex.z;
+		}
+
+		result.push_back(corners);
+	}
+
+	std::sort(result.begin(), result.end());
+
+	return result;
+}
+
+// Renderer::drawModel() from above the generated grid, with the screen
+// cleared between passes (which isn't counted)
+double benchDrawModel(Renderer& renderer, Camera& camera, const Model& model, std::vector<Light>& lights) {
+	renderer.camera_matrix = AffineTransform::camera(camera.rotation, camera.position);
+	renderer.setUpFrustumPlanes(camera.viewport);
+	renderer.stats = RenderStats();
+
+	double total = 0;
+
+	for (int pass = 0; pass < BENCH_REORDER_PASSES; pass++) {
+		device::clearScreen(device::getColorValue(1.0, 1.0, 1.0));
+
+		auto start = bench_clock::now();
+		renderer.drawModel(model, camera.viewport, lights, 0);
+		renderer.tile_rasterizer->flush(renderer.fill_method);
+		total += millisecondsSince(start);
+	}
+
+	return total / BENCH_REORDER_PASSES;
+}
+
+// the way Entity::buildWorldModel() used to build its matrices, by
+// multiplying a 4x4 for each axis, the scale and the translation, for
+// comparison with AffineTransform
+void buildWorldMatricesAsProducts(
+		double scale, Vector rotation, Vector position, Matrix& world, Matrix& normal) {
+	auto rotationMatrix = [](Vector rotation) {
+		Matrix x = Matrix::makeAxisRotationMatrix(rotation.x * -1, x_axis);
+		Matrix y = Matrix::makeAxisRotationMatrix(rotation.y * -1, y_axis);
+		Matrix z = Matrix::makeAxisRotationMatrix(rotation.z * -1, z_axis);
+
+		return z.multiplyMatrix(y.multiplyMatrix(x));
+	};
+
+	world = Matrix::makeTranslationMatrix(position)
+			.multiplyMatrix(Matrix::makeScaleMatrix(scale))
+			.multiplyMatrix(rotationMatrix(rotation));
+	normal = rotationMatrix(rotation);
+}
+
+// renders BENCH_FRAMES frames, looking in BENCH_VIEWS directions
+double benchFrames(BenchWorld& world, Renderer& renderer) {
+	Camera& camera = world.scene.camera;
+	double total = 0;
+
+	for (int view = 0; view < BENCH_VIEWS; view++) {
+		camera.rotation = Vector::direction(0, kTau * view / BENCH_VIEWS, 0);
+
+		// warm up
+		renderer.drawScene(world.scene);
+
+		auto start = bench_clock::now();
+
+		for (int frame = 0; frame < BENCH_FRAMES / BENCH_VIEWS; frame++) {
+			renderer.drawScene(world.scene);
+		}
+
+		total += millisecondsSince(start);
+	}
+
+	camera.rotation = Vector::direction(0, 0, 0);
+
+	return total / BENCH_FRAMES;
+}
+
+
+int main(int argc, char** argv) {
+	if (!device::setUp()) {
+		return 1;
+	}
+
+	BenchWorld world;
+	setUpBenchWorld(world);
+
+	Renderer renderer = Renderer::create(world.scene.camera.viewport);
+
+	if (shouldRun(argc, argv, "frame")) {
+		printf(
+				"frame: %.3f ms per frame (%s z buffer, %u raster threads)\n",
+				benchFrames(world, renderer),
+				depth_format_name,
+				renderer.tile_rasterizer->threadCount());
+	}
+
+	// each of the ways to fill triangles (see FillMethod)
+	if (shouldRun(argc, argv, "fill")) {
+		const char* names[] = {"scanline", "barycentric", "edge function"};
+		FillMethod methods[] = {
+				FillMethod::scanline, FillMethod::barycentric, FillMethod::edge_function};
+		RendererSettings saved = RendererSettings::save(renderer);
+
+		for (int i = 0; i < 3; i++) {
+			renderer.fill_method = methods[i];
+
+			printf(
+					"fill: %.3f ms per frame (%s)\n",
+					benchFrames(world, renderer),
+					names[i]);
+		}
+
+		saved.restore(renderer);
+	}
+
+	// whole triangles rejected by the hierarchical z buffer (see
+	// Triangle2D::isOccluded()) with each fill method, which the tiled ones
+	// count once per tile
+	if (shouldRun(argc, argv, "hiz")) {
+		const char* names[] = {"scanline", "barycentric", "edge function"};
+		FillMethod methods[] = {
+				FillMethod::scanline, FillMethod::barycentric, FillMethod::edge_function};
+		RendererSettings saved = RendererSettings::save(renderer);
+		bool edge_function_occluded = false;
+
+		for (int i = 0; i < 3; i++) {
+			renderer.fill_method = methods[i];
+			int occluded = 0;
+
+			for (int view = 0; view < BENCH_VIEWS; view++) {
+				world.scene.camera.rotation = Vector::direction(0, kTau * view / BENCH_VIEWS, 0);
+				renderer.drawScene(world.scene);
+				occluded += renderer.stats.triangles_occluded;
+			}
+
+			world.scene.camera.rotation = Vector::direction(0, 0, 0);
+
+			if (methods[i] == FillMethod::edge_function) {
+				edge_function_occluded = occluded > 0;
+			}
+
+			printf(
+					"hiz: %.3f ms per frame, %d triangles occluded per frame (%s)\n",
+					benchFrames(world, renderer),
+					occluded / BENCH_VIEWS,
+					names[i]);
+		}
+
+		saved.restore(renderer);
+
+		if (USE_HIERARCHICAL_Z && !edge_function_occluded) {
+			printf("hiz: FAILED, the default fill method didn't reject any triangles\n");
+			return 1;
+		}
+	}
+
+	// perspective spans (see Triangle2D::perspective_span) against dividing at
+	// every pixel, for speed and for how different the frames look
+	if (shouldRun(argc, argv, "perspective")) {
+		RendererSettings saved = RendererSettings::save(renderer);
+		renderer.fill_method = FillMethod::scanline;
+
+		int spans[] = {0, 8, 16, 32};
+		bool within_bounds = true;
+
+		for (int span : spans) {
+			renderer.perspective_span = span;
+			double frame_time = benchFrames(world, renderer);
+			ImageDiff worst;
+
+			for (int view = 0; view < BENCH_VIEWS; view++) {
+				world.scene.camera.rotation =
+						Vector::direction(0, kTau * view / BENCH_VIEWS, 0);
+
+				renderer.perspective_span = 0;
+				renderer.drawScene(world.scene);
+
+				std::vector<uint32_t> exact(
+						device::getFramebuffer(),
+						device::getFramebuffer() + device::getXRes() * device::getYRes());
+
+				renderer.perspective_span = span;
+				renderer.drawScene(world.scene);
+
+				ImageDiff diff = diffFrames(exact, device::getFramebuffer());
+
+				worst.max_error = std::max(worst.max_error, diff.max_error);
+				worst.mean_error = std::max(worst.mean_error, diff.mean_error);
+				worst.differing_pixels =
+						std::max(worst.differing_pixels, diff.differing_pixels);
+			}
+
+			world.scene.camera.rotation = Vector::direction(0, 0, 0);
+
+			printf(
+					"perspective: %.3f ms per frame (span %d), vs exact: %.2f%% of pixels differ, mean error %.4f, max error %d\n",
+					frame_time,
+					span,
+					worst.differing_pixels * 100,
+					worst.mean_error,
+					worst.max_error);
+
+			if (span <= PERSPECTIVE_CHECKED_SPAN
+					&& worst.mean_error > PERSPECTIVE_MAX_MEAN_ERROR) {
+				within_bounds = false;
+			}
+		}
+
+		saved.restore(renderer);
+
+		if (!within_bounds) {
+			printf(
+					"perspective: FAILED, spans up to %d should have a mean error under %.2f\n",
+					PERSPECTIVE_CHECKED_SPAN,
+					PERSPECTIVE_MAX_MEAN_ERROR);
+			return 1;
+		}
+	}
+
+	if (shouldRun(argc, argv, "clear")) {
+		int white = device::getColorValue(1.0, 1.0, 1.0);
+		int black = device::getColorValue(0.0, 0.0, 0.0);
+
+		auto nothing = [] {};
+
+		benchClear("per pixel setPixel() loop", nothing, [&](int i) {
+			clearScreenPerPixel(white);
+		});
+
+		// changing colors forces clearScreen() to clear everything
+		benchClear("full clearScreen()", nothing, [&](int i) {
+			device::clearScreen(i % 2 ? white : black);
+		});
+
+		// a typical frame, where only what was drawn needs clearing
+		benchClear(
+				"lazy clearScreen() after drawing the scene",
+				[&] { renderer.drawScene(world.scene); },
+				[&](int i) { device::clearScreen(white); });
+	}
+
+	// culling whole models against the frustum, see Renderer::cull_models
+	if (shouldRun(argc, argv, "cull")) {
+		// culling shouldn't change what's drawn
+		bool culled_visible_models = false;
+		RendererSettings saved = RendererSettings::save(renderer);
+
+		for (int view = 0; view < BENCH_VIEWS; view++) {
+			world.scene.camera.rotation = Vector::direction(0, kTau * view / BENCH_VIEWS, 0);
+
+			renderer.cull_models = false;
+			renderer.drawScene(world.scene);
+
+			std::vector<uint32_t> unculled(
+					device::getFramebuffer(),
+					device::getFramebuffer() + device::getXRes() * device::getYRes());
+
+			renderer.cull_models = true;
+			renderer.drawScene(world.scene);
+
+			ImageDiff diff = diffFrames(unculled, device::getFramebuffer());
+
+			printf(
+					"cull: view %d, %d models drawn, %d culled, %.2f%% of pixels differ from not culling\n",
+					view,
+					renderer.stats.models_drawn,
+					renderer.stats.models_culled,
+					diff.differing_pixels * 100);
+
+			if (diff.differing_pixels > 0) {
+				culled_visible_models = true;
+			}
+		}
+
+		world.scene.camera.rotation = Vector::direction(0, 0, 0);
+
+		for (int cull = 0; cull < 2; cull++) {
+			renderer.cull_models = cull;
+
+			printf(
+					"cull: %.3f ms per frame (%s)\n",
+					benchFrames(world, renderer),
+					cull ? "culling models" : "not culling");
+		}
+
+		// a crate is only 12 triangles, so culling one saves next to nothing next
+		// to filling the frame, whereas most of a ring of teapots around the
+		// camera is behind it or off to the side, with a thousand triangles each
+		// to transform and reject
+		Model teapot = loadModelFile(teapot_model_file);
+		size_t entity_count = world.scene.entities.size();
+
+		for (int i = 0; i < BENCH_CULL_TEAPOTS; i++) {
+			double angle = kTau * i / BENCH_CULL_TEAPOTS;
+			Vector position = world.scene.camera.position.add(
+					Vector::direction(20 * sin(angle), -1, -20 * cos(angle)));
+
+			addStaticEntity(world.scene, &teapot, position);
+			world.scene.entities.back().scale = 0.04;
+			world.scene.entities.back().buildWorldModel();
+		}
+
+		for (int cull = 0; cull < 2; cull++) {
+			renderer.cull_models = cull;
+
+			printf(
+					"cull: %.3f ms per frame with %d teapots around the camera (%s)\n",
+					benchFrames(world, renderer),
+					BENCH_CULL_TEAPOTS,
+					cull ? "culling models" : "not culling");
+		}
+
+		world.scene.entities.resize(entity_count);
+		saved.restore(renderer);
+
+		if (culled_visible_models) {
+			printf("cull: FAILED, culling changed the frame\n");
+			return 1;
+		}
+	}
+
+	// drawing opaque models nearest first, see Renderer::sort_models
+	// the crates are added nearest first, so reversing them is the worst case
+	if (shouldRun(argc, argv, "sort")) {
+		std::vector<Entity>& entities = world.scene.entities;
+		const char* names[] = {"scene order", "reversed scene order", "sorted"};
+		RendererSettings saved = RendererSettings::save(renderer);
+
+		for (int i = 0; i < 3; i++) {
+			renderer.sort_models = i == 2;
+
+			if (i > 0) {
+				std::reverse(entities.begin(), entities.end());
+			}
+
+			double overdraw = 0;
+			int occluded = 0;
+
+			for (int view = 0; view < BENCH_VIEWS; view++) {
+				world.scene.camera.rotation = Vector::direction(0, kTau * view / BENCH_VIEWS, 0);
+				renderer.drawScene(world.scene);
+				overdraw += renderer.stats.overdraw;
+				occluded += renderer.stats.triangles_occluded;
+			}
+
+			world.scene.camera.rotation = Vector::direction(0, 0, 0);
+
+			printf(
+					"sort: %.3f ms per frame, %.2f pixels shaded per pixel, %d triangles occluded per frame (%s)\n",
+					benchFrames(world, renderer),
+					overdraw / BENCH_VIEWS,
+					occluded / BENCH_VIEWS,
+					names[i]);
+		}
+
+		saved.restore(renderer);
+
+#if !COUNT_OVERDRAW
+		printf("sort: overdraw unavailable, built with COUNT_OVERDRAW=0\n");
+#endif
+	}
+
+	// static models through the span buffer instead of the z buffer, see
+	// Renderer::use_span_buffer
+	// every model in the benchmark scene is static, apart from the player's
+	if (shouldRun(argc, argv, "span")) {
+		const char* fill_names[] = {"scanline", "edge function"};
+		FillMethod fill_methods[] = {FillMethod::scanline, FillMethod::edge_function};
+		RendererSettings saved = RendererSettings::save(renderer);
+
+		for (int fill = 0; fill < 2; fill++) {
+			renderer.fill_method = fill_methods[fill];
+
+			for (int span = 0; span < 2; span++) {
+				double overdraw = 0;
+				double differing_pixels = 0;
+				int spans = 0;
+
+				for (int view = 0; view < BENCH_VIEWS; view++) {
+					world.scene.camera.rotation = Vector::direction(0, kTau * view / BENCH_VIEWS, 0);
+
+					renderer.use_span_buffer = false;
+					renderer.drawScene(world.scene);
+
+					std::vector<uint32_t> z_buffered(
+							device::getFramebuffer(),
+							device::getFramebuffer() + device::getXRes() * device::getYRes());
+
+					renderer.use_span_buffer = span;
+					renderer.drawScene(world.scene);
+
+					overdraw += renderer.stats.overdraw;
+					spans += renderer.stats.static_spans_drawn;
+					differing_pixels += diffFrames(z_buffered, device::getFramebuffer()).differing_pixels;
+				}
+
+				world.scene.camera.rotation = Vector::direction(0, 0, 0);
+
+				printf(
+						"span: %.3f ms per frame, %.2f pixels shaded per pixel, %d spans per frame, %.2f%% of pixels differ from the z buffer (%s, %s)\n",
+						benchFrames(world, renderer),
+						overdraw / BENCH_VIEWS,
+						spans / BENCH_VIEWS,
+						differing_pixels / BENCH_VIEWS * 100,
+						fill_names[fill],
+						span ? "span buffer" : "z buffer");
+			}
+		}
+
+		saved.restore(renderer);
+
+#if !COUNT_OVERDRAW
+		printf("span: overdraw unavailable, built with COUNT_OVERDRAW=0\n");
+#endif
+	}
+
+	// static models' lighting cached between frames, and lit every frame, see
+	// Renderer::cache_static_lighting
+	if (shouldRun(argc, argv, "lighting")) {
+		double differing_pixels = 0;
+		RendererSettings saved = RendererSettings::save(renderer);
+
+		for (int view = 0; view < BENCH_VIEWS; view++) {
+			world.scene.camera.rotation = Vector::direction(0, kTau * view / BENCH_VIEWS, 0);
+
+			renderer.cache_static_lighting = false;
+			renderer.drawScene(world.scene);
+
+			std::vector<uint32_t> uncached(
+					device::getFramebuffer(),
+					device::getFramebuffer() + device::getXRes() * device::getYRes());
+
+			renderer.cache_static_lighting = true;
+			renderer.drawScene(world.scene);
+
+			differing_pixels += diffFrames(uncached, device::getFramebuffer()).differing_pixels;
+		}
+
+		world.scene.camera.rotation = Vector::direction(0, 0, 0);
+
+		for (int cache = 0; cache < 2; cache++) {
+			renderer.cache_static_lighting = cache;
+
+			printf(
+					"lighting: %.3f ms per frame (%s)\n",
+					benchFrames(world, renderer),
+					cache ? "cached" : "lit every frame");
+		}
+
+		saved.restore(renderer);
+
+		if (differing_pixels > 0) {
+			printf("lighting: FAILED, caching changed the frame\n");
+			return 1;
+		}
+	}
+
+	// frustum clipping with and without outcodes, and with the guard band
+	if (shouldRun(argc, argv, "clip")) {
+		Model city = loadModelFile(city_model_file);
+
+		// roughly the middle of the city, at street level
+		Vector eye = Vector::point(3.8, 0.5, 4.8);
+
+		const char* names[] = {"all six planes", "outcodes", "guard band"};
+		ClipMode modes[] = {ClipMode::all_planes, ClipMode::outcodes, ClipMode::guard_band};
+
+		for (int i = 0; i < 3; i++) {
+			ClipStats stats = benchClipping(renderer, city, eye, modes[i]);
+
+			printf(
+					"clip: %.4f ms per %d views of city.obj (%s), %zu inside, %zu rejected, %zu clipped against %zu planes, %zu triangles drawn\n",
+					stats.milliseconds,
+					BENCH_CLIP_VIEWS,
+					names[i],
+					stats.inside,
+					stats.rejected,
+					stats.clipped,
+					stats.planes_clipped,
+					stats.triangles);
+		}
+	}
+
+	// loading a generated OBJ file with a million quads on one thread and on
+	// one per hardware thread, see parseOBJFile()
+	if (shouldRun(argc, argv, "obj")) {
+		writeGridOBJ(bench_obj_file, BENCH_OBJ_GRID);
+
+		auto start = bench_clock::now();
+		Model single = parseOBJFile(bench_obj_file, 1);
+		double single_milliseconds = millisecondsSince(start);
+
+		start = bench_clock::now();
+		Model parallel = parseOBJFile(bench_obj_file, 0);
+		double parallel_milliseconds = millisecondsSince(start);
+
+		remove(bench_obj_file);
+
+		printf(
+				"obj: %.1f ms to load %zu triangles on one thread, %.1f ms on %u\n",
+				single_milliseconds,
+				single.triangles.size(),
+				parallel_milliseconds,
+				std::max(1u, std::thread::hardware_concurrency()));
+
+		start = bench_clock::now();
+		Model city = parseOBJFile(city_model_file);
+
+		printf(
+				"obj: %.3f ms to load city.obj (%zu triangles)\n",
+				millisecondsSince(start),
+				city.triangles.size());
+
+		if (single.triangles.size() != 2 * BENCH_OBJ_GRID * BENCH_OBJ_GRID
+				|| !sameTriangles(single, parallel)) {
+			printf("obj: FAILED, the parallel loader's model is different\n");
+			return 1;
+		}
+	}
+
+	// loading the generated OBJ file's model from a binary mesh, see mesh.h
+	if (shouldRun(argc, argv, "mesh")) {
+		writeGridOBJ(bench_obj_file, BENCH_OBJ_GRID);
+
+		auto start = bench_clock::now();
+		Model parsed = parseOBJFile(bench_obj_file);
+		double parse_milliseconds = millisecondsSince(start);
+
+		remove(bench_obj_file);
+
+		if (!saveMesh(parsed, bench_mesh_file)) {
+			terminateFatal("couldn't write the benchmark mesh file");
+		}
+
+		Model loaded;
+		start = bench_clock::now();
+		bool valid = loadMesh(bench_mesh_file, loaded);
+		double load_milliseconds = millisecondsSince(start);
+
+		remove(bench_mesh_file);
+
+		printf(
+				"mesh: %.1f ms to parse %zu triangles from an OBJ file, %.1f ms to load them from a mesh\n",
+				parse_milliseconds,
+				parsed.triangles.size(),
+				load_milliseconds);
+
+		if (!valid || !sameTriangles(parsed, loaded)) {
+			printf("mesh: FAILED, the mesh's model is different\n");
+			return 1;
+		}
+	}
+
+	// welding and reordering a model for vertex cache locality, see
+	// optimizeModel()
+	// the grid is written in rows, which is already about as good as it gets,
+	// so it's shuffled first, and each quad has its own copies of its corners,
+	// the way some exporters leave models
+	if (shouldRun(argc, argv, "reorder")) {
+		writeGridOBJ(bench_obj_file, BENCH_REORDER_GRID, false);
+		Model shuffled = parseOBJFile(bench_obj_file);
+		remove(bench_obj_file);
+
+		std::mt19937 random(1);
+		std::shuffle(shuffled.triangles.begin(), shuffled.triangles.end(), random);
+		shuffled.setTriangleNormals();
+
+		Model optimized = shuffled;
+		auto start = bench_clock::now();
+		MeshOptimization optimization = optimizeModel(optimized);
+		double optimize_milliseconds = millisecondsSince(start);
+
+		printf(
+				"reorder: %.1f ms to optimize %zu triangles, %zu vertices welded into %zu, %zu texture coordinates into %zu, ACMR %.3f shuffled, %.3f reordered\n",
+				optimize_milliseconds,
+				optimized.triangles.size(),
+				optimization.vertices_before,
+				optimization.vertices_after,
+				optimization.uvs_before,
+				optimization.uvs_after,
+				optimization.acmr_before,
+				optimization.acmr_after);
+
+		Camera& camera = world.scene.camera;
+		Camera saved_camera = camera;
+
+		// over the middle of the grid, looking down at it
+		camera.position = Vector::point(1, 1.5, -1);
+		camera.rotation = Vector::direction(kTau / 4, 0, 0);
+
+		const char* names[] = {"shuffled", "reordered"};
+		Model* models[] = {&shuffled, &optimized};
+
+		bool culled = false;
+
+		for (int i = 0; i < 2; i++) {
+			printf(
+					"reorder: %.3f ms to draw the grid (%s)\n",
+					benchDrawModel(renderer, camera, *models[i], world.scene.lights),
+					names[i]);
+
+			culled = culled || renderer.stats.models_drawn == 0;
+		}
+
+		camera = saved_camera;
+
+		if (culled
+				|| sortedTriangleCorners(shuffled) != sortedTriangleCorners(optimized)
+				|| optimization.vertices_after >= optimization.vertices_before
+				|| optimization.uvs_after >= optimization.uvs_before
+				|| optimization.acmr_after >= optimization.acmr_before) {
+			printf("reorder: FAILED, the optimized model is different, wasn't welded or is no better\n");
+			return 1;
+		}
+	}
+
+	// setting up each entity's world and normal transforms, see
+	// Entity::buildWorldModel()
+	if (shouldRun(argc, argv, "matrix")) {
+		std::mt19937 random(1);
+		std::uniform_real_distribution<double> angle(-kTau, kTau);
+		std::uniform_real_distribution<double> coordinate(-50, 50);
+		std::vector<Vector> rotations(BENCH_MATRIX_ENTITIES);
+		std::vector<Vector> positions(BENCH_MATRIX_ENTITIES);
+
+		for (int i = 0; i < BENCH_MATRIX_ENTITIES; i++) {
+			rotations[i] = Vector::direction(angle(random), angle(random), angle(random));
+			positions[i] = Vector::point(coordinate(random), coordinate(random), coordinate(random));
+		}
+
+		std::vector<Matrix> product_worlds(BENCH_MATRIX_ENTITIES);
+		std::vector<Matrix> product_normals(BENCH_MATRIX_ENTITIES);
+		std::vector<AffineTransform> worlds(BENCH_MATRIX_ENTITIES);
+		std::vector<AffineTransform> normals(BENCH_MATRIX_ENTITIES);
+
+		auto start = bench_clock::now();
+
+		for (int i = 0; i < BENCH_MATRIX_ENTITIES; i++) {
+			buildWorldMatricesAsProducts(
+					1.5, rotations[i], positions[i], product_worlds[i], product_normals[i]);
+		}
+
+		double product_milliseconds = millisecondsSince(start);
+		start = bench_clock::now();
+
+		for (int i = 0; i < BENCH_MATRIX_ENTITIES; i++) {
+			normals[i] = AffineTransform::rotation(rotations[i]);
+			worlds[i] = AffineTransform::world(1.5, normals[i], positions[i]);
+		}
+
+		double affine_milliseconds = millisecondsSince(start);
+
+		// they should be exactly the same, not just close
+		bool same = true;
+
+		for (int i = 0; i < BENCH_MATRIX_ENTITIES; i++) {
+			Matrix world = worlds[i].toMatrix();
+			Matrix normal = normals[i].toMatrix();
+
+			for (int row = 0; row < 4; row++) {
+				for (int column = 0; column < 4; column++) {
+					same = same
+							&& world.at(row, column) == product_worlds[i].at(row, column)
+							&& normal.at(row, column) == product_normals[i].at(row, column);
+				}
+			}
+		}
+
+		printf(
+				"matrix: %.3f ms to set up %d entities' transforms with 4x4 products, %.3f ms with AffineTransform\n",
+				product_milliseconds,
+				BENCH_MATRIX_ENTITIES,
+				affine_milliseconds);
+
+		if (!same) {
+			printf("matrix: FAILED, the transforms aren't the same as the products\n");
+			return 1;
+		}
+	}
+
+	// moving points into camera space a Vector at a time, the way models used
+	// to be, and all at once from a VertexStream, see transformPoints()
+	if (shouldRun(argc, argv, "transform")) {
+		std::mt19937 random(1);
+		std::uniform_real_distribution<double> coordinate(-50, 50);
+		std::vector<Vector> points(BENCH_TRANSFORM_POINTS);
+
+		for (auto& point : points) {
+			point = Vector::point(coordinate(random), coordinate(random), coordinate(random));
+		}
+
+		VertexStream stream;
+		stream.setPoints(points);
+
+		AffineTransform camera = AffineTransform::camera(
+				Vector::direction(0.3, 1.2, 0), Vector::point(4, 1.5, -7));
+		Matrix matrix = camera.toMatrix();
+		std::vector<Vector> transformed(points.size());
+		VertexStream transformed_stream;
+
+		auto start = bench_clock::now();
+
+		for (int pass = 0; pass < BENCH_TRANSFORM_PASSES; pass++) {
+			for (size_t i = 0; i < points.size(); i++) {
+				transformed[i] = matrix.multiplyVector(points[i]);
+			}
+		}
+
+		double vector_milliseconds = millisecondsSince(start) / BENCH_TRANSFORM_PASSES;
+		start = bench_clock::now();
+
+		for (int pass = 0; pass < BENCH_TRANSFORM_PASSES; pass++) {
+			for (size_t i = 0; i < points.size(); i++) {
+				transformed[i] = camera.transformPoint(points[i]);
+			}
+		}
+
+		double affine_milliseconds = millisecondsSince(start) / BENCH_TRANSFORM_PASSES;
+		start = bench_clock::now();
+
+		for (int pass = 0; pass < BENCH_TRANSFORM_PASSES; pass++) {
+			transformPoints(camera, stream, transformed_stream);
+		}
+
+		double stream_milliseconds = millisecondsSince(start) / BENCH_TRANSFORM_PASSES;
+		double max_error = 0;
+
+		for (size_t i = 0; i < points.size(); i++) {
+			max_error = std::max(
+					max_error,
+					transformed_stream.point(i).subtract(transformed[i]).length());
+		}
+
+		printf(
+				"transform: %.3f ms per %d points a Vector at a time with a Matrix, %.3f ms with an AffineTransform, %.3f ms from a VertexStream, at most %.2g apart\n",
+				vector_milliseconds,
+				BENCH_TRANSFORM_POINTS,
+				affine_milliseconds,
+				stream_milliseconds,
+				max_error);
+
+		if (max_error > BENCH_TRANSFORM_MAX_ERROR) {
+			printf("transform: FAILED, the VertexStream's points are too far off\n");
+			return 1;
+		}
+	}
+
+	// how frame times scale with the number of TileRasterizer threads, up to
+	// one per hardware thread
+	if (shouldRun(argc, argv, "threads")) {
+		unsigned int max_threads = std::thread::hardware_concurrency();
+
+		for (unsigned int threads = 1; threads <= max_threads; threads *= 2) {
+			renderer.setRasterThreads(threads);
+
+			printf(
+					"threads: %.3f ms per frame with %u raster threads\n",
+					benchFrames(world, renderer),
+					threads);
+		}
+
+		renderer.setRasterThreads(RASTER_THREADS);
+	}
+
+	device::tearDown();
+
+	return 0;
+}
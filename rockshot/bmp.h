@@ -100,47 +100,23 @@ bmp_info_t readBMPFile(const char* filename) {
 struct BMPTexture : public Texture {
 	bmp_info_t bmp_info;
 
-	// uint32_t colorFromUV(double u, double v) {
-	// 	// if (u < -0.0001 || u > 1.0001 || v < -0.0001 || v > 1.0001) {
-	// 	// 	printf("got bad uv - u: %f, v: %f\n", u, v);
-	// 	// 	return 0;
-	// 	// }
-	//
-	// 	int x = (bmp_info.width - 1) * u;
-	// 	int y = (bmp_info.height - 1) * v;
-	//
-	// 	size_t index = (bmp_info.width * y + x) * bmp_info.bytes_per_pixel;
-	//
-	// 	unsigned char blue = bmp_info.pixel_buffer[index];
-	// 	unsigned char green = bmp_info.pixel_buffer[index + 1];
-	// 	unsigned char red = bmp_info.pixel_buffer[index + 2];
-	//
-	// 	uint32_t raw_color = (red << 24) + (green << 16) + (blue << 8);
-	//
-	// 	return raw_color;
-	// }
-
-	Vector vectorColorFromUV(double u, double v) override {
-		int x = (bmp_info.width - 1) * u;
-		int y = (bmp_info.height - 1) * v;
-
-		size_t index = (bmp_info.width * y + x) * bmp_info.bytes_per_pixel;
-
-		unsigned char blue = bmp_info.pixel_buffer[index];
-		unsigned char green = bmp_info.pixel_buffer[index + 1];
-		unsigned char red = bmp_info.pixel_buffer[index + 2];
-
-		return Vector::color(
-				(double)red / 255,
-				(double)green / 255,
-				(double)blue / 255);
-	}
-
 	static BMPTexture load(const char* filename) {
 		BMPTexture result;
 
 		result.bmp_info = readBMPFile(filename);
 
+		bmp_info_t& info = result.bmp_info;
+
+		result.setTexels(info.width, info.height, [&info](int x, int y) {
+			size_t index = (info.width * y + x) * info.bytes_per_pixel;
+
+			unsigned char blue = info.pixel_buffer[index];
+			unsigned char green = info.pixel_buffer[index + 1];
+			unsigned char red = info.pixel_buffer[index + 2];
+
+			return texelFromRGB(red, green, blue);
+		});
+
 		return result;
 	}
 };
@@ -0,0 +1,293 @@
+#ifndef BUFFDOG_BSP
+#define BUFFDOG_BSP
+
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include "quake_types.h"
+#include "texture.h"
+
+
+// Views into the lumps of a Quake .bsp file, see quake_types.h.  Everything
+// points into the raw file, which has to outlive the BSP.  See BSPWorld for
+// turning one into something that can be drawn.
+
+
+struct Color {
+  unsigned char red;
+  unsigned char green;
+  unsigned char blue;
+
+  void log() {
+    printf("color: %d %d %d\n", this->red, this->green, this->blue);
+  }
+};
+
+
+struct BSPTexture {
+  char* name;
+  int width;
+  int height;
+  unsigned char* color_data;
+  Color* palette;
+
+  // palette indices of each mip level, color_data is the first
+  unsigned char* mip_data[4];
+
+  // uses the miptex's own mip levels instead of generating them
+  Texture buildTexture() const {
+    Texture texture;
+
+    texture.setMipTexels(this->width, this->height, 4, [this](int level, int x, int y) {
+      const Color& color = this->palette[this->mip_data[level][y * (this->width >> level) + x]];
+
+      return texelFromRGB(color.red, color.green, color.blue);
+    });
+
+    return texture;
+  }
+
+  void dumpToPPM() const {
+    constexpr char const* k_ppm_location_format = "tex/%s.ppm";
+
+    char output_file[64];
+    int result = sprintf(output_file, k_ppm_location_format, this->name);
+
+    if (result < 0) {
+      throw std::runtime_error("failed to write output file name");
+    }
+
+    std::ofstream output;
+    output.open(output_file);
+    output << "P3\n" << this->width << " " << this->height << "\n255\n";
+
+    for (int i = 0; i < this->width * this->height; i++) {
+      Color& color = palette[this->color_data[i]];
+      output << (int)color.red << " " << (int)color.green << " " << (int)color.blue << "\n";
+    }
+
+    output.close();
+  }
+};
+
+
+struct BSP {
+  model_t* models;
+  int model_count;
+
+  std::vector<BSPTexture> textures;
+
+  texinfo_t* texinfos;
+  int texinfo_count;
+
+  plane_t* planes;
+  int plane_count;
+
+  face_t* faces;
+  int face_count;
+
+  edge_t* edges;
+  int edge_count;
+
+  int* edge_list;
+  int edge_list_size;
+
+  vec3_t* vertices;
+  int vertex_count;
+
+  node_t* nodes;
+  int node_count;
+
+  leaf_t* leaves;
+  int leaf_count;
+
+  // indices into faces, each leaf has a range of them
+  unsigned short* face_list;
+  int face_list_size;
+
+  // run length encoded visibility lists, see leaf_t::vislist
+  unsigned char* visilist;
+  int visilist_size;
+
+  // light levels from 0 (dark) to 255, each lit face has a block of them, see
+  // face_t::lightmap
+  unsigned char* lightmaps;
+  int lightmaps_size;
+
+  // the entities lump is text, not necessarily null terminated
+  char* entities;
+  int entities_size;
+
+  BSP(std::vector<unsigned char>& raw_bsp, Color* palette) {
+    // printf("bsp bytes: %lu\n", raw_bsp.size());
+    bsp_header_t* header = (bsp_header_t*)raw_bsp.data();
+
+    // models
+    bsp_entry_t& models_entry = header->models;
+    this->model_count = models_entry.size / sizeof(model_t);
+    this->models = (model_t*)(&(raw_bsp.data()[models_entry.offset]));
+
+    // textures
+    bsp_entry_t& textures_entry = header->miptex;
+    unsigned char* raw_textures = &(raw_bsp.data()[textures_entry.offset]);
+    miptexheader_t* tex_header = (miptexheader_t*)(raw_textures);
+    this->textures.resize(tex_header->nummiptex);
+
+    for (int i = 0; i < tex_header->nummiptex; i++) {
+      // textures that weren't found when the map was compiled are left out
+      if (tex_header->dataofs[i] == -1) {
+        this->textures[i] = BSPTexture{};
+        continue;
+      }
+
+      unsigned char* local_tex_head = raw_textures + tex_header->dataofs[i];
+      miptex_t* miptex = (miptex_t*)local_tex_head;
+
+      this->textures[i].width = miptex->width;
+      this->textures[i].height = miptex->height;
+      this->textures[i].color_data = &(local_tex_head[miptex->offset1]);
+      this->textures[i].mip_data[0] = &(local_tex_head[miptex->offset1]);
+      this->textures[i].mip_data[1] = &(local_tex_head[miptex->offset2]);
+      this->textures[i].mip_data[2] = &(local_tex_head[miptex->offset4]);
+      this->textures[i].mip_data[3] = &(local_tex_head[miptex->offset8]);
+      this->textures[i].name = miptex->name;
+      this->textures[i].palette = palette;
+    }
+
+    // texinfos
+    bsp_entry_t& texinfos_entry = header->texinfo;
+    this->texinfo_count = texinfos_entry.size / sizeof(texinfo_t);
+    this->texinfos = (texinfo_t*)(&(raw_bsp.data()[texinfos_entry.offset]));
+
+    // planes
+    bsp_entry_t& planes_entry = header->planes;
+    this->plane_count = planes_entry.size / sizeof(plane_t);
+    this->planes = (plane_t*)(&(raw_bsp.data()[planes_entry.offset]));
+
+    // faces
+    bsp_entry_t& faces_entry = header->faces;
+    this->face_count = faces_entry.size / sizeof(face_t);
+    this->faces = (face_t*)(&(raw_bsp.data()[faces_entry.offset]));
+
+    // face list
+    bsp_entry_t& face_list_entry = header->face_list;
+    this->face_list_size = face_list_entry.size / sizeof(unsigned short);
+    this->face_list = (unsigned short*)(&(raw_bsp.data()[face_list_entry.offset]));
+
+    // edges
+    bsp_entry_t& edges_entry = header->edges;
+    this->edge_count = edges_entry.size / sizeof(edge_t);
+    this->edges = (edge_t*)(&(raw_bsp.data()[edges_entry.offset]));
+
+    // edge list
+    bsp_entry_t& edge_list_entry = header->edge_list;
+    this->edge_list_size = edge_list_entry.size / sizeof(int);
+    this->edge_list = (int*)(&(raw_bsp.data()[edge_list_entry.offset]));
+
+    // vertices
+    bsp_entry_t& vertices_entry = header->vertices;
+    this->vertex_count = vertices_entry.size / sizeof(vec3_t);
+    this->vertices = (vec3_t*)(&(raw_bsp.data()[vertices_entry.offset]));
+
+    // nodes
+    bsp_entry_t& nodes_entry = header->nodes;
+    this->node_count = nodes_entry.size / sizeof(node_t);
+    this->nodes = (node_t*)(&(raw_bsp.data()[nodes_entry.offset]));
+
+    // leaves
+    bsp_entry_t& leaves_entry = header->leaves;
+    this->leaf_count = leaves_entry.size / sizeof(leaf_t);
+    this->leaves = (leaf_t*)(&(raw_bsp.data()[leaves_entry.offset]));
+
+    // visibility lists
+    bsp_entry_t& visilist_entry = header->visilist;
+    this->visilist_size = visilist_entry.size;
+    this->visilist = &(raw_bsp.data()[visilist_entry.offset]);
+
+    // lightmaps
+    bsp_entry_t& lightmaps_entry = header->lightmaps;
+    this->lightmaps_size = lightmaps_entry.size;
+    this->lightmaps = &(raw_bsp.data()[lightmaps_entry.offset]);
+
+    // entities
+    bsp_entry_t& entities_entry = header->entities;
+    this->entities_size = entities_entry.size;
+    this->entities = (char*)(&(raw_bsp.data()[entities_entry.offset]));
+  }
+
+  void log() {
+    printf("number of models: %d\n", this->model_count);
+    printf("number of textures: %lu\n", this->textures.size());
+    printf("number of texinfos: %d\n", this->texinfo_count);
+    printf("number of planes: %d\n", this->plane_count);
+    printf("number of faces: %d\n", this->face_count);
+    printf("number of edges: %d\n", this->edge_count);
+    printf("size of edge list: %d\n", this->edge_list_size);
+    printf("number of vertices: %d\n", this->vertex_count);
+    printf("number of nodes: %d\n", this->node_count);
+    printf("number of leaves: %d\n", this->leaf_count);
+    printf("size of face list: %d\n", this->face_list_size);
+    printf("size of visibility lists: %d\n", this->visilist_size);
+    printf("size of lightmaps: %d\n", this->lightmaps_size);
+
+    // for (int i = 0; i < this->texinfo_count; i++) {
+    //   texinfo_t* tex = (texinfo_t*)(&(this->texinfos[i]));
+
+    //   printf("texinfo %d:\n", i);
+    //   printf("  texture_id: %d\n", tex->texture_id);
+    //   printf("  vectorS: ");
+    //   tex->vectorS.log();
+    // }
+
+    for (int model_index = 0; model_index < this->model_count; model_index++) {
+      model_t* model = (model_t*)(&(this->models[model_index]));
+
+      printf(
+          "number of faces in model %d: %d, first_face: %d\n",
+          model_index,
+          model->face_count,
+          model->first_face);
+      printf("  boundbox min: ");
+      model->boundbox.min.log();
+      printf("  boundbox max: ");
+      model->boundbox.max.log();
+      printf("  origin: ");
+      model->origin.log();
+      printf("  first bsp node: %d\n", model->first_bsp_node);
+      printf("  first clip node: %d\n", model->first_clip_node);
+      printf("  second clip node: %d\n", model->second_clip_node);
+      printf("  empty node: %d\n", model->empty_node);
+      printf("  bsp leaf count: %d\n", model->bsp_leaf_count);
+
+      // // get faces
+      // for (int face_index = 0; face_index < model->face_count; face_index++) {
+      //   face_t& face = this->faces[face_index];
+
+      //   printf("  face %d\n:", face_index);
+      //   printf("    plane_id: %d\n:", face.plane_id);
+      //   printf("    side: %d\n:", face.side);
+      //   printf("    edge_list_id: %d\n:", face.edge_list_id);
+      //   printf("    edge_count: %d\n:", face.edge_count);
+      //   printf("    texinfo_id: %d\n:", face.texinfo_id);
+      // }
+
+      // // get texinfo
+      // for (int face_index = model->first_face; face_index < model->face_count; face_index++) {
+      //   face_t& face = this->faces[face_index];
+
+      //   printf("  face %d\n", face_index);
+
+      //   printf("    texinfo_id: %d\n", face.texinfo_id);
+      //   texinfo_t* tex = (texinfo_t*)(&(this->texinfos[face.texinfo_id]));
+      //   printf("      texture name: %s\n", this->textures[tex->texture_id].name);
+      //   printf("      vectorS: ");
+      //   tex->vectorS.log();
+      //   printf("      vectorT: ");
+      //   tex->vectorT.log();
+      // }
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,537 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "../util.h"
+
+#include "bsp_world.h"
+
+
+// Quake's player origin is at the middle of its bounding box, 24 units above
+// its feet
+constexpr double kQuakePlayerOriginHeight = 24;
+
+// the lightmap level that shows a texture as it is, Quake lets light go up to
+// twice as bright, which is clamped here, see shadeFromIntensity()
+constexpr double kQuakeNormalLight = 128;
+
+// faces without a texture are drawn this gray
+constexpr unsigned char kUntexturedGray = 128;
+
+// leaf indices are stored as negative children, see node_t
+inline bool isLeafChild(int child) {
+	return child < 0;
+}
+
+inline int leafFromChild(int child) {
+	return -(child + 1);
+}
+
+// surfaces are textures, so their sides have to be powers of two
+int surfaceSize(int extent) {
+	int size = 1;
+
+	while (size < extent) {
+		size *= 2;
+	}
+
+	return size;
+}
+
+// the texture wraps around, including at negative coordinates
+inline int wrapTexel(int texel, int size) {
+	return ((texel % size) + size) % size;
+}
+
+// finds the value of key in the first entity with the given classname, e.g.
+// { "classname" "info_player_start" "origin" "480 -352 88" }
+std::string findEntityValue(const BSP& bsp, const char* classname, const char* key) {
+	std::string entities(bsp.entities, strnlen(bsp.entities, bsp.entities_size));
+	std::string classname_pair = std::string("\"classname\" \"") + classname + "\"";
+
+	size_t found = entities.find(classname_pair);
+
+	if (found == std::string::npos) {
+		return "";
+	}
+
+	size_t start = entities.rfind('{', found);
+	size_t end = entities.find('}', found);
+	std::string entity = entities.substr(start, end - start);
+	std::string key_quoted = std::string("\"") + key + "\"";
+
+	size_t key_position = entity.find(key_quoted);
+
+	if (key_position == std::string::npos) {
+		return "";
+	}
+
+	size_t value_start = entity.find('"', key_position + key_quoted.size());
+	size_t value_end = entity.find('"', value_start + 1);
+
+	if (value_start == std::string::npos || value_end == std::string::npos) {
+		return "";
+	}
+
+	return entity.substr(value_start + 1, value_end - value_start - 1);
+}
+
+void BSPWorld::build(BSP& bsp) {
+	// textures, indexed the same as the BSP's, except that missing ones are
+	// skipped
+	std::vector<int> texture_indices(bsp.textures.size(), -1);
+
+	for (size_t i = 0; i < bsp.textures.size(); i++) {
+		if (bsp.textures[i].width > 0) {
+			texture_indices[i] = this->textures.size();
+			this->textures.push_back(bsp.textures[i].buildTexture());
+			this->texture_sizes.push_back(
+					std::make_pair(bsp.textures[i].width, bsp.textures[i].height));
+		}
+	}
+
+	for (int i = 0; i < bsp.vertex_count; i++) {
+		this->model.vertices.push_back(pointFromQuake(bsp.vertices[i]));
+	}
+
+	// the world is always the first model, the rest are brush entities
+	model_t& world_model = bsp.models[0];
+
+	this->faces.resize(bsp.face_count);
+
+	for (int face_index = 0; face_index < bsp.face_count; face_index++) {
+		face_t& bsp_face = bsp.faces[face_index];
+		Face& face = this->faces[face_index];
+
+		face.first_triangle = this->model.triangles.size();
+		face.triangle_count = 0;
+		face.texture = -1;
+		face.back = bsp_face.side != 0;
+		face.texture_mins[0] = 0;
+		face.texture_mins[1] = 0;
+		face.extents[0] = 0;
+		face.extents[1] = 0;
+		face.lightmap = -1;
+		face.visible_frame = 0;
+		face.surface_frame = 0;
+
+		// brush entities' faces are left empty
+		if (face_index < world_model.first_face
+				|| face_index >= world_model.first_face + world_model.face_count) {
+			continue;
+		}
+
+		texinfo_t& texinfo = bsp.texinfos[bsp_face.texinfo_id];
+		int texture_id = texinfo.texture_id;
+
+		if (texture_id >= 0 && texture_id < (int)texture_indices.size()) {
+			face.texture = texture_indices[texture_id];
+		}
+
+		plane_t& plane = bsp.planes[bsp_face.plane_id];
+		Vector normal = directionFromQuake(plane.normal);
+
+		if (face.back) {
+			normal = normal.scalarMultiply(-1);
+		}
+
+		// a face's edges go around it, so it can be triangulated as a fan from its
+		// first vertex
+		size_t first_uv = this->model.uvs.size();
+		std::vector<size_t> face_vertices;
+		std::vector<std::pair<double, double> > face_texels;
+		double mins[2] = {DBL_MAX, DBL_MAX};
+		double maxs[2] = {-DBL_MAX, -DBL_MAX};
+
+		for (int i = 0; i < bsp_face.edge_count; i++) {
+			int edge_id = bsp.edge_list[bsp_face.edge_list_id + i];
+			size_t vertex_index = edge_id >= 0
+					? (unsigned short)bsp.edges[edge_id].start_vertex
+					: (unsigned short)bsp.edges[-edge_id].end_vertex;
+			vec3_t& vertex = bsp.vertices[vertex_index];
+
+			double s = vertex.x * texinfo.vectorS.x
+					+ vertex.y * texinfo.vectorS.y
+					+ vertex.z * texinfo.vectorS.z
+					+ texinfo.distS;
+			double t = vertex.x * texinfo.vectorT.x
+					+ vertex.y * texinfo.vectorT.y
+					+ vertex.z * texinfo.vectorT.z
+					+ texinfo.distT;
+
+			face_vertices.push_back(vertex_index);
+			face_texels.push_back(std::make_pair(s, t));
+
+			mins[0] = std::min(mins[0], s);
+			mins[1] = std::min(mins[1], t);
+			maxs[0] = std::max(maxs[0], s);
+			maxs[1] = std::max(maxs[1], t);
+		}
+
+		// the same rounding as Quake's light tool, so that the lightmap lines up
+		for (int axis = 0; axis < 2; axis++) {
+			int low = (int)floor(mins[axis] / kLightmapSampleTexels);
+			int high = (int)ceil(maxs[axis] / kLightmapSampleTexels);
+
+			face.texture_mins[axis] = low * kLightmapSampleTexels;
+			face.extents[axis] = (high - low) * kLightmapSampleTexels;
+		}
+
+		int samples =
+				(face.extents[0] / kLightmapSampleTexels + 1)
+				* (face.extents[1] / kLightmapSampleTexels + 1);
+
+		if (bsp_face.lightmap >= 0 && bsp_face.lightmap + samples <= bsp.lightmaps_size) {
+			face.lightmap = bsp_face.lightmap;
+		}
+
+		// the face's texture coordinates are into its surface, see faceSurface(),
+		// whose texels are one unit of s and t each, starting at texture_mins
+		int surface_width = surfaceSize(face.extents[0]);
+		int surface_height = surfaceSize(face.extents[1]);
+
+		for (auto& texel : face_texels) {
+			this->model.uvs.push_back(std::make_pair(
+					(texel.first - face.texture_mins[0]) / surface_width,
+					(texel.second - face.texture_mins[1]) / surface_height));
+		}
+
+		for (size_t i = 1; i + 1 < face_vertices.size(); i++) {
+			Triangle3D triangle;
+			triangle.v0 = Vertex{face_vertices[0], 0, first_uv, 1.0};
+			triangle.v1 = Vertex{face_vertices[i], 0, first_uv + i, 1.0};
+			triangle.v2 = Vertex{face_vertices[i + 1], 0, first_uv + i + 1, 1.0};
+			triangle.color = Vector::color(0.5, 0.5, 0.5);
+			triangle.normal = normal;
+
+			this->model.triangles.push_back(triangle);
+			face.triangle_count++;
+		}
+	}
+
+	this->nodes.resize(bsp.node_count);
+
+	for (int i = 0; i < bsp.node_count; i++) {
+		node_t& bsp_node = bsp.nodes[i];
+		Node& node = this->nodes[i];
+		plane_t& plane = bsp.planes[bsp_node.plane_id];
+
+		node.plane = directionFromQuake(plane.normal);
+		node.plane.w = -plane.dist * kQuakeUnitScale;
+		node.children[0] = bsp_node.children[0];
+		node.children[1] = bsp_node.children[1];
+		node.parent = -1;
+		node.first_face = bsp_node.first_face;
+		node.face_count = bsp_node.face_count;
+		node.visible_frame = 0;
+	}
+
+	this->leaves.resize(bsp.leaf_count);
+
+	for (int i = 0; i < bsp.leaf_count; i++) {
+		leaf_t& bsp_leaf = bsp.leaves[i];
+		Leaf& leaf = this->leaves[i];
+
+		leaf.vislist = bsp_leaf.vislist;
+		leaf.first_face = bsp_leaf.face_list_id;
+		leaf.face_count = bsp_leaf.face_count;
+		leaf.parent = -1;
+	}
+
+	// nodes only point down the tree, but visible leaves are marked by walking
+	// up it
+	for (int i = 0; i < bsp.node_count; i++) {
+		for (int child : this->nodes[i].children) {
+			if (isLeafChild(child)) {
+				this->leaves[leafFromChild(child)].parent = i;
+			} else {
+				this->nodes[child].parent = i;
+			}
+		}
+	}
+
+	// lighting comes from the lightmaps instead
+	this->model.compute_lighting = false;
+	this->lightmaps.assign(bsp.lightmaps, bsp.lightmaps + bsp.lightmaps_size);
+	this->surfaces.resize(this->faces.size());
+
+	this->face_list.assign(bsp.face_list, bsp.face_list + bsp.face_list_size);
+	this->visilist.assign(bsp.visilist, bsp.visilist + bsp.visilist_size);
+	this->root_node = world_model.first_bsp_node;
+	this->visible_leaf_count = world_model.bsp_leaf_count;
+	this->leaf_visibility.resize((this->visible_leaf_count + 7) / 8);
+
+	std::string origin = findEntityValue(bsp, "info_player_start", "origin");
+	vec3_t start;
+
+	if (sscanf(origin.c_str(), "%f %f %f", &start.x, &start.y, &start.z) == 3) {
+		start.z -= kQuakePlayerOriginHeight;
+		this->start_position = pointFromQuake(start);
+	}
+}
+
+int BSPWorld::findLeaf(Vector position) {
+	int child = this->root_node;
+
+	while (!isLeafChild(child)) {
+		Node& node = this->nodes[child];
+		child = node.children[node.plane.dotProduct(position) >= 0 ? 0 : 1];
+	}
+
+	return leafFromChild(child);
+}
+
+// Quake's PVS run length encodes zeros: a zero byte is followed by how many
+// zero bytes it stands for, anything else is copied as is
+void BSPWorld::decompressVisibility(int vislist) {
+	const unsigned char* in = &this->visilist[vislist];
+	const unsigned char* in_end = this->visilist.data() + this->visilist.size();
+	size_t out = 0;
+
+	while (out < this->leaf_visibility.size() && in < in_end) {
+		if (*in != 0) {
+			this->leaf_visibility[out++] = *in++;
+			continue;
+		}
+
+		int count = in + 1 < in_end ? in[1] : 0;
+		in += 2;
+
+		while (count > 0 && out < this->leaf_visibility.size()) {
+			this->leaf_visibility[out++] = 0;
+			count--;
+		}
+	}
+
+	// a list that's cut short leaves the rest invisible
+	while (out < this->leaf_visibility.size()) {
+		this->leaf_visibility[out++] = 0;
+	}
+}
+
+void BSPWorld::markVisibleLeaf(int leaf_index) {
+	Leaf& leaf = this->leaves[leaf_index];
+
+	for (int i = 0; i < leaf.face_count; i++) {
+		this->faces[this->face_list[leaf.first_face + i]].visible_frame = this->frame;
+	}
+
+	// stop as soon as this reaches a node that's already been marked by another
+	// leaf, everything above it has been too
+	int node = leaf.parent;
+
+	while (node >= 0 && this->nodes[node].visible_frame != this->frame) {
+		this->nodes[node].visible_frame = this->frame;
+		node = this->nodes[node].parent;
+	}
+}
+
+void BSPWorld::addVisibleFaces(int node_index, Vector eye) {
+	Node& node = this->nodes[node_index];
+
+	if (node.visible_frame != this->frame) {
+		return;
+	}
+
+	// eye's side first, so that nearer faces come first
+	int side = node.plane.dotProduct(eye) >= 0 ? 0 : 1;
+
+	if (!isLeafChild(node.children[side])) {
+		this->addVisibleFaces(node.children[side], eye);
+	}
+
+	// only faces on eye's side of the plane can face it
+	for (int i = node.first_face; i < node.first_face + node.face_count; i++) {
+		Face& face = this->faces[i];
+
+		if (face.visible_frame == this->frame && face.back == (side == 1)) {
+			this->visible_faces.push_back(i);
+		}
+	}
+
+	if (!isLeafChild(node.children[1 - side])) {
+		this->addVisibleFaces(node.children[1 - side], eye);
+	}
+}
+
+const std::vector<int>& BSPWorld::findVisibleFaces(Vector eye) {
+	this->frame++;
+	this->visible_faces.clear();
+
+	if (this->nodes.empty()) {
+		return this->visible_faces;
+	}
+
+	int eye_leaf = this->findLeaf(eye);
+	int vislist = this->leaves[eye_leaf].vislist;
+
+	// leaf 0 is solid, so being in it (or in a leaf without a PVS) means the
+	// camera is somewhere it shouldn't be, and anything could be visible
+	bool everything_visible =
+			eye_leaf == 0 || vislist < 0 || vislist >= (int)this->visilist.size();
+
+	if (!everything_visible) {
+		this->decompressVisibility(vislist);
+	}
+
+	this->markVisibleLeaf(eye_leaf);
+
+	// bit i is leaf i + 1
+	for (int i = 0; i < this->visible_leaf_count; i++) {
+		if (everything_visible || (this->leaf_visibility[i >> 3] & (1 << (i & 7)))) {
+			this->markVisibleLeaf(i + 1);
+		}
+	}
+
+	this->addVisibleFaces(this->root_node, eye);
+
+	return this->visible_faces;
+}
+
+// Each texel of the surface is the face's texture where it is, shaded by the
+// lightmap, which is filtered between the four nearest samples.  Only the
+// first of Quake's light styles is used, so flickering lights don't flicker.
+void BSPWorld::buildSurface(const Face& face, Texture& surface) {
+	const Texture* texture = face.texture >= 0 ? &this->textures[face.texture] : nullptr;
+	int texture_width = texture ? this->texture_sizes[face.texture].first : 1;
+	int texture_height = texture ? this->texture_sizes[face.texture].second : 1;
+
+	int sample_width = face.extents[0] / kLightmapSampleTexels + 1;
+	int sample_height = face.extents[1] / kLightmapSampleTexels + 1;
+	const unsigned char* samples =
+			face.lightmap >= 0 ? &this->lightmaps[face.lightmap] : nullptr;
+
+	uint32_t untextured = texelFromRGB(kUntexturedGray, kUntexturedGray, kUntexturedGray);
+
+	surface.setTexels(
+			surfaceSize(face.extents[0]),
+			surfaceSize(face.extents[1]),
+			[&](int x, int y) {
+				uint32_t texel = untextured;
+
+				if (texture) {
+					// scaled from the map's texture size to the resized texture
+					int s = wrapTexel(face.texture_mins[0] + x, texture_width);
+					int t = wrapTexel(face.texture_mins[1] + y, texture_height);
+
+					texel = texture->texel(
+							s * texture->width / texture_width,
+							t * texture->height / texture_height);
+				}
+
+				if (!samples) {
+					return texel;
+				}
+
+				// surfaces are rounded up to powers of two, past the last sample
+				double sample_x = std::min((double)x / kLightmapSampleTexels, sample_width - 1.0);
+				double sample_y = std::min((double)y / kLightmapSampleTexels, sample_height - 1.0);
+				int x0 = (int)sample_x;
+				int y0 = (int)sample_y;
+				int x1 = std::min(x0 + 1, sample_width - 1);
+				int y1 = std::min(y0 + 1, sample_height - 1);
+				double fraction_x = sample_x - x0;
+				double fraction_y = sample_y - y0;
+
+				double top =
+						samples[y0 * sample_width + x0] * (1 - fraction_x)
+						+ samples[y0 * sample_width + x1] * fraction_x;
+				double bottom =
+						samples[y1 * sample_width + x0] * (1 - fraction_x)
+						+ samples[y1 * sample_width + x1] * fraction_x;
+				double light = top * (1 - fraction_y) + bottom * fraction_y;
+
+				return shadeTexel(texel, shadeFromIntensity(light / kQuakeNormalLight));
+			});
+}
+
+Texture* BSPWorld::faceSurface(int face_index) {
+	Face& face = this->faces[face_index];
+	Texture& surface = this->surfaces[face_index];
+
+	face.surface_frame = this->frame;
+
+	if (surface.texels.empty()) {
+		this->buildSurface(face, surface);
+		this->surface_texels += surface.texels.size();
+
+		if (this->surface_texels > this->surface_cache_texels) {
+			this->evictSurfaces();
+		}
+	}
+
+	return &surface;
+}
+
+// throws out the least recently drawn surfaces until the cache fits again,
+// except the ones drawn this frame, since they may not have been rasterized yet
+void BSPWorld::evictSurfaces() {
+	std::vector<std::pair<uint32_t, int> > built;
+
+	for (size_t i = 0; i < this->surfaces.size(); i++) {
+		if (!this->surfaces[i].texels.empty() && this->faces[i].surface_frame != this->frame) {
+			built.push_back(std::make_pair(this->faces[i].surface_frame, (int)i));
+		}
+	}
+
+	std::sort(built.begin(), built.end());
+
+	for (auto& surface : built) {
+		if (this->surface_texels <= this->surface_cache_texels) {
+			break;
+		}
+
+		this->surface_texels -= this->surfaces[surface.second].texels.size();
+		this->surfaces[surface.second] = Texture();
+	}
+}
+
+void BSPWorld::translate(Vector offset) {
+	for (auto& vertex : this->model.vertices) {
+		vertex = vertex.add(offset);
+	}
+
+	this->model.positions.setPoints(this->model.vertices);
+
+	// a point's distance in front of a plane is the same once both have moved
+	for (auto& node : this->nodes) {
+		node.plane.w -= node.plane.x * offset.x + node.plane.y * offset.y + node.plane.z * offset.z;
+	}
+
+	this->start_position = this->start_position.add(offset);
+}
+
+BSPWorld loadBSPWorld(const char* bsp_file, const char* palette_file) {
+	BSPWorld world;
+	std::vector<unsigned char> raw_bsp;
+	std::vector<unsigned char> raw_palette;
+
+	try {
+		raw_bsp = util::readFile(bsp_file);
+		raw_palette = util::readFile(palette_file);
+	} catch (const std::runtime_error& error) {
+		printf("couldn't read map %s or palette %s!\n", bsp_file, palette_file);
+		return world;
+	}
+
+	if (raw_bsp.size() < sizeof(bsp_header_t) || raw_palette.size() < 256 * sizeof(Color)) {
+		printf("map %s or palette %s is too small!\n", bsp_file, palette_file);
+		return world;
+	}
+
+	BSP bsp(raw_bsp, (Color*)raw_palette.data());
+
+	if (bsp.model_count < 1) {
+		printf("map %s has no world model!\n", bsp_file);
+		return world;
+	}
+
+	world.build(bsp);
+	world.model.setBounds();
+	world.valid = true;
+
+	return world;
+}
@@ -0,0 +1,155 @@
+#ifndef BUFFDOG_BSP_WORLD
+#define BUFFDOG_BSP_WORLD
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "../vector.h"
+
+#include "bsp.h"
+#include "model.h"
+#include "texture.h"
+
+
+// Quake units are roughly an inch, this makes the player (56 units) about 1.75
+// meters tall
+constexpr double kQuakeUnitScale = 1.0 / 32;
+
+// converts a position from Quake's coordinates (z up) to ours (y up)
+inline Vector pointFromQuake(const vec3_t& vec) {
+	return Vector::point(
+			vec.x * kQuakeUnitScale,
+			vec.z * kQuakeUnitScale,
+			-vec.y * kQuakeUnitScale);
+}
+
+// the same, for directions, which aren't scaled
+inline Vector directionFromQuake(const vec3_t& vec) {
+	return Vector::direction(vec.x, vec.z, -vec.y);
+}
+
+// Quake's lightmaps have a sample every 16 texels
+constexpr int kLightmapSampleTexels = 16;
+
+// the most texels (including mip levels) that lit surfaces can take up before
+// the least recently drawn ones are thrown out, see BSPWorld::faceSurface()
+constexpr size_t kSurfaceCacheTexels = 4 * 1024 * 1024;
+
+
+// The world geometry of a Quake map, ready for Renderer::drawWorld().
+// All of its faces are triangulated into one model, so its vertices only
+// need to be transformed once per frame, and the BSP tree and potentially
+// visible sets (PVS) are kept to find which faces could be visible from the
+// camera, nearest first.
+// Faces are lit by the map's lightmaps rather than the scene's lights.  Like
+// Quake's surface cache, each face's texture is combined with its lightmap into
+// a lit surface the first time it's drawn, so drawing it is a plain texture
+// lookup, and lighting costs nothing per frame.
+// Only the world itself is drawn, not brush entities like doors.
+struct BSPWorld {
+	struct Face {
+		size_t first_triangle; // in model.triangles
+		int triangle_count;
+		int texture; // in textures, or -1 if it didn't have one
+		bool back; // it faces the back of its plane
+
+		// the corner of the face in texture space, and its size from there,
+		// rounded out to lightmap samples
+		int texture_mins[2];
+		int extents[2];
+
+		int lightmap; // in lightmaps, or -1 if it's fully lit
+
+		uint32_t visible_frame;
+		uint32_t surface_frame; // the last frame its surface was drawn
+	};
+
+	struct Node {
+		// the dot product of a point and the plane is its distance in front of it
+		Vector plane;
+		int children[2]; // front and back, see node_t
+		int parent;
+		int first_face;
+		int face_count;
+
+		// nodes above visible leaves are marked, so that the rest of the tree can
+		// be skipped
+		uint32_t visible_frame;
+	};
+
+	struct Leaf {
+		int vislist; // see leaf_t
+		int first_face; // in face_list
+		int face_count;
+		int parent;
+	};
+
+	Model model;
+	std::vector<Texture> textures;
+
+	// each texture's size in the map, before it was resized to powers of two
+	std::vector<std::pair<int, int> > texture_sizes;
+
+	std::vector<unsigned char> lightmaps;
+
+	// each face's texture and lightmap combined, or empty if it hasn't been
+	// built (or has been thrown out), see faceSurface()
+	std::vector<Texture> surfaces;
+	size_t surface_texels = 0;
+	size_t surface_cache_texels = kSurfaceCacheTexels;
+
+	std::vector<Face> faces;
+	std::vector<Node> nodes;
+	std::vector<Leaf> leaves;
+	std::vector<unsigned short> face_list;
+	std::vector<unsigned char> visilist;
+	int root_node = 0;
+
+	// the leaves that have PVS bits, leaf 0 (solid space) isn't one of them
+	int visible_leaf_count = 0;
+
+	// where info_player_start is, if there is one
+	Vector start_position = Vector::origin();
+
+	bool valid = false;
+
+	// the faces from the last call to findVisibleFaces()
+	std::vector<int> visible_faces;
+
+	// the index of the leaf that position is in
+	int findLeaf(Vector position);
+
+	// Finds the faces in the PVS of the leaf that eye is in, which face eye,
+	// ordered nearest first by walking the BSP tree towards eye's side of each
+	// node first.
+	// eye is in world space, the result is also kept in visible_faces
+	const std::vector<int>& findVisibleFaces(Vector eye);
+
+	// moves everything, including start_position, by offset
+	void translate(Vector offset);
+
+	// the lit surface to draw a face with, built if it isn't cached
+	// surfaces drawn this frame are never thrown out, so the result stays valid
+	// until the next call to findVisibleFaces()
+	Texture* faceSurface(int face_index);
+
+private:
+	uint32_t frame = 0;
+	std::vector<unsigned char> leaf_visibility; // one bit per visible leaf
+
+	void build(BSP& bsp);
+	void decompressVisibility(int vislist);
+	void markVisibleLeaf(int leaf_index);
+	void addVisibleFaces(int node_index, Vector eye);
+	void buildSurface(const Face& face, Texture& surface);
+	void evictSurfaces();
+
+	friend BSPWorld loadBSPWorld(const char* bsp_file, const char* palette_file);
+};
+
+// palette_file is Quake's gfx/palette.lmp, which the textures are indexed into
+// the result isn't valid if either file couldn't be read
+BSPWorld loadBSPWorld(const char* bsp_file, const char* palette_file);
+
+#endif
@@ -9,27 +9,27 @@
 
 // in other words... the vertex shader??
 void Entity::buildWorldModel() {
-	Matrix worldMatrix = Matrix::makeWorldMatrix(
-		this->scale, this->rotation, this->position);
-
-	this->model_in_world = *(this->model);
-
-	for (auto& vertex : model_in_world.vertices) {
-		// transform to world space
-		vertex = worldMatrix.multiplyVector(vertex);
-	}
-
-	Matrix normalTransformationMatrix =
-		Matrix::makeRotationMatrix(this->rotation);
+	// normals are only rotated, and the world transform is that rotation
+	// scaled and moved, so the sines and cosines are only found once
+	AffineTransform rotation = AffineTransform::rotation(this->rotation);
+	AffineTransform world = AffineTransform::world(this->scale, rotation, this->position);
+
+	this->model_in_world.setTransformed(*(this->model), world, rotation);
+	this->world_model_built = true;
+	this->built_position = this->position;
+	this->built_rotation = this->rotation;
+	this->built_scale = this->scale;
+}
 
-	for (auto& normal : model_in_world.normals) {
-		normal = normalTransformationMatrix.multiplyVector(normal);
-	}
+static bool sameVector(const Vector& a, const Vector& b) {
+	return a.x == b.x && a.y == b.y && a.z == b.z;
+}
 
-	for (auto& triangle : model_in_world.triangles) {
-		triangle.normal =
-			normalTransformationMatrix.multiplyVector(triangle.normal);
-	}
+bool Entity::worldModelIsCurrent() const {
+	return this->world_model_built
+		&& this->scale == this->built_scale
+		&& sameVector(this->position, this->built_position)
+		&& sameVector(this->rotation, this->built_rotation);
 }
 
 void Entity::applyForce(Vector applied_force, Vector point_of_application) {
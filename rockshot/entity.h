@@ -47,6 +47,13 @@ struct Entity {
 	bool active = true;
 	bool is_static = false; // non-moving items
 
+	// static entities' world models are only built again when they've been
+	// moved, rotated or scaled since the last time, see Scene::step()
+	bool world_model_built = false;
+	Vector built_position = Vector::origin();
+	Vector built_rotation = Vector::direction(0, 0, 0);
+	double built_scale = 1.0;
+
 	// newly created entities should always be added to the scene through
 	// addEntity() or addEntityWithAction(), which will set scene and action
 	// appropriately
@@ -96,6 +103,10 @@ struct Entity {
 
 	void buildWorldModel();
 
+	// whether the world model was built with the current position, rotation
+	// and scale
+	bool worldModelIsCurrent() const;
+
 	// PHYSICS
 
 	// parameter value should be in meters per second
@@ -0,0 +1,104 @@
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "level.h"
+
+
+void logLevelLoadError(const char* message, std::string line) {
+	printf("%s: %s\n", message, line.c_str());
+}
+
+Model buildFighterModel(float height, float width, float eye_height) {
+		// the model will have its bottom centered at the origin
+		Vector start = Vector::point(-width, 0, -width);
+		Vector end = Vector::point(width, height, width);
+
+		return Model::buildHexahedron(start, end);
+	}
+
+LevelData loadLevelFromFile(const char* filename) {
+	std::ifstream level_file(filename);
+	LevelData level_data;
+
+	bool got_fighter_dimensions = false;
+
+	if (!level_file.is_open()) {
+		printf("couldn't read level file %s!\n", filename);
+		return level_data;
+	}
+
+	std::string line;
+
+	while (std::getline(level_file, line)) {
+		if (line.size() == 0 || line[0] == '#') {
+			continue;
+		}
+
+		std::istringstream line_stream(line);
+		char first_char;
+		line_stream >> first_char;
+
+		if (first_char == 'i') {
+			// shared fighter info
+			if (!(line_stream >> level_data.fighter_height >> level_data.fighter_width >> level_data.fighter_eye_height)) {
+				logLevelLoadError("fighter shared info improperly formatted!", line);
+				return level_data;
+			}
+
+			got_fighter_dimensions = true;
+		} else if (first_char == 'f') {
+			// load a fighter
+			if (!got_fighter_dimensions) {
+				logLevelLoadError("need shared fighter info before loading fighters!", line);
+				return level_data;
+			}
+
+			Entity fighter;
+
+			if (!(line_stream >> fighter.position.x >> fighter.position.y >> fighter.position.z)) {
+				logLevelLoadError("fighter position improperly formatted!", line);
+				return level_data;
+			}
+
+			if (!(line_stream >> fighter.rotation.x >> fighter.rotation.y >> fighter.rotation.z)) {
+				logLevelLoadError("fighter rotation improperly formatted!", line);
+				return level_data;
+			}
+
+			level_data.fighters.push_back(fighter);
+		} else if (first_char == 'p') {
+			Platform platform;
+
+			if (!(line_stream >> platform.start_pos.x >> platform.start_pos.y >> platform.start_pos.z)) {
+				logLevelLoadError("platform start position improperly formatted!", line);
+				return level_data;
+			}
+
+			if (!(line_stream >> platform.end_pos.x >> platform.end_pos.y >> platform.end_pos.z)) {
+				logLevelLoadError("platform end position improperly formatted!", line);
+				return level_data;
+			}
+
+			platform.model = Model::buildHexahedron(platform.start_pos, platform.end_pos);
+
+			level_data.platforms.push_back(platform);
+		} else {
+			logLevelLoadError("unrecognized line", line);
+		}
+	}
+
+	if (level_data.fighters.size() < 1) {
+		printf("no fighters found in level %s!\n", filename);
+	} else if (level_data.platforms.size() < 1) {
+		printf("no platforms found in level %s!\n", filename);
+	} else {
+		level_data.fighter_model = buildFighterModel(
+				level_data.fighter_height,
+				level_data.fighter_width,
+				level_data.fighter_eye_height);
+		level_data.valid = true;
+	}
+
+	return level_data;
+}
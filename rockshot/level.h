@@ -0,0 +1,36 @@
+#ifndef BUFFDOG_LEVEL
+#define BUFFDOG_LEVEL
+
+#include <vector>
+
+#include "../vector.h"
+
+#include "entity.h"
+#include "model.h"
+
+
+// struct Fighter {
+// 	Vector pos = Vector::origin();
+// 	Vector rot = Vector::direction(0.0, 0.0, 0.0);
+// };
+
+struct Platform {
+	Vector start_pos = Vector::origin();
+	Vector end_pos = Vector::origin();
+	Model model;
+};
+
+struct LevelData {
+	std::vector<Entity> fighters;
+	std::vector<Platform> platforms;
+	bool valid = false;
+
+	float fighter_height;
+	float fighter_width;
+	float fighter_eye_height;
+	Model fighter_model; // fighters share the same model for now
+};
+
+LevelData loadLevelFromFile(const char* filename);
+
+#endif
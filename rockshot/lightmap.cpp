@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include "../device.h"
+
+#include "lightmap.h"
+
+
+// the faces are laid out in a grid of this many squares across
+constexpr int kBoxLightmapColumns = 4;
+constexpr int kBoxLightmapRows = 2;
+
+// shadow rays start this far off the face, so it doesn't shadow itself
+constexpr double kShadowBias = 1e-4;
+
+
+// whether a ray from point towards direction hits any of the boxes, found by
+// clipping it to each box's slabs
+bool isShadowed(Vector point, Vector direction, const std::vector<AABB>& occluders) {
+	for (auto box : occluders) {
+		double nearest = 0;
+		double farthest = DBL_MAX;
+
+		for (int axis = 0; axis < 3 && nearest <= farthest; axis++) {
+			double origin = point.at(axis);
+			double step = direction.at(axis);
+			double min = box.min_pos.at(axis);
+			double max = box.max_pos.at(axis);
+
+			if (fabs(step) < DBL_EPSILON) {
+				// parallel to the slab, so it's either always in it or never
+				if (origin < min || origin > max) {
+					farthest = -1;
+				}
+
+				continue;
+			}
+
+			double enter = (min - origin) / step;
+			double leave = (max - origin) / step;
+
+			if (enter > leave) {
+				std::swap(enter, leave);
+			}
+
+			nearest = std::max(nearest, enter);
+			farthest = std::min(farthest, leave);
+		}
+
+		if (nearest <= farthest) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// the same as Renderer::applyLighting(), except that directional lights can
+// be blocked by the occluders
+double bakedLightAt(
+		Vector point,
+		Vector normal,
+		const std::vector<AABB>& occluders,
+		const std::vector<Light>& lights) {
+	Vector ray_start = point.add(normal.scalarMultiply(kShadowBias));
+	double result = 0;
+
+	for (auto& light : lights) {
+		if (light.type == Light::Type::directional) {
+			double directional_light = normal.dotProduct(light.direction);
+
+			if (directional_light > 0 && !isShadowed(ray_start, light.direction, occluders)) {
+				result += directional_light * light.intensity;
+			}
+		} else {
+			result += light.intensity;
+		}
+	}
+
+	return result;
+}
+
+void bakeBoxLightmap(
+		Model& box,
+		Texture& lightmap,
+		const std::vector<AABB>& occluders,
+		const std::vector<Light>& lights) {
+	// each face is a pair of triangles
+	int face_count = std::min(
+			(int)box.triangles.size() / 2,
+			kBoxLightmapColumns * kBoxLightmapRows);
+	int width = kBoxLightmapColumns * kBoxLightmapSize;
+	int height = kBoxLightmapRows * kBoxLightmapSize;
+
+	// the faces share the lightmap, so its mip levels stop while each face
+	// still has 2 x 2 texels of its own, before neighboring faces are averaged
+	// together
+	int level_count = Texture::nearestPowerOfTwoShift(kBoxLightmapSize);
+
+	lightmap.setTexels(width, height, [&](int x, int y) {
+		int face = (y / kBoxLightmapSize) * kBoxLightmapColumns + x / kBoxLightmapSize;
+
+		if (face >= face_count) {
+			return device::getColorValue(0, 0, 0);
+		}
+
+		// the texture coordinates of the middle of the texel on the face, which
+		// covers 1 / kBoxLightmapSize of it, like MipLevel
+		double u = (x % kBoxLightmapSize + 0.5) / kBoxLightmapSize;
+		double v = (y % kBoxLightmapSize + 0.5) / kBoxLightmapSize;
+
+		// faces are flat, so anywhere on them is a mix of the first triangle's
+		// corners, in the same proportions as its texture coordinates
+		Triangle3D& triangle = box.triangles[face * 2];
+		std::pair<double, double>& uv0 = box.uvs[triangle.v0.uv];
+		std::pair<double, double>& uv1 = box.uvs[triangle.v1.uv];
+		std::pair<double, double>& uv2 = box.uvs[triangle.v2.uv];
+
+		double du1 = uv1.first - uv0.first;
+		double dv1 = uv1.second - uv0.second;
+		double du2 = uv2.first - uv0.first;
+		double dv2 = uv2.second - uv0.second;
+		double determinant = du1 * dv2 - du2 * dv1;
+		double weight1 = ((u - uv0.first) * dv2 - du2 * (v - uv0.second)) / determinant;
+		double weight2 = (du1 * (v - uv0.second) - (u - uv0.first) * dv1) / determinant;
+
+		Vector p0 = box.vertices[triangle.v0.index];
+		Vector point = p0
+				.add(box.vertices[triangle.v1.index].subtract(p0).scalarMultiply(weight1))
+				.add(box.vertices[triangle.v2.index].subtract(p0).scalarMultiply(weight2));
+
+		double light = std::min(1.0, bakedLightAt(point, triangle.normal, occluders, lights));
+
+		return device::getColorValue(
+				triangle.color.x * light,
+				triangle.color.y * light,
+				triangle.color.z * light);
+	}, level_count);
+
+	// each face's texture coordinates move into its square
+	std::vector<std::pair<double, double> > uvs;
+
+	for (int face = 0; face < face_count; face++) {
+		int left = (face % kBoxLightmapColumns) * kBoxLightmapSize;
+		int top = (face / kBoxLightmapColumns) * kBoxLightmapSize;
+		size_t first_uv = uvs.size();
+
+		for (auto& uv : box.uvs) {
+			uvs.push_back(std::make_pair(
+					(left + uv.first * kBoxLightmapSize) / width,
+					(top + uv.second * kBoxLightmapSize) / height));
+		}
+
+		for (int i = face * 2; i < face * 2 + 2; i++) {
+			box.triangles[i].v0.uv += first_uv;
+			box.triangles[i].v1.uv += first_uv;
+			box.triangles[i].v2.uv += first_uv;
+		}
+	}
+
+	box.uvs = uvs;
+	box.setTexture(&lightmap);
+	box.compute_lighting = false;
+}
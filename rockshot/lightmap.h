@@ -0,0 +1,32 @@
+#ifndef BUFFDOG_LIGHTMAP
+#define BUFFDOG_LIGHTMAP
+
+#include <vector>
+
+#include "../vector.h"
+
+#include "collision.h"
+#include "model.h"
+#include "scene.h"
+#include "texture.h"
+
+
+// the lightmap texels along each side of each face of a box
+constexpr int kBoxLightmapSize = 16;
+
+
+// Bakes lights into a lightmap for a box made by Model::buildHexahedron(),
+// including the shadows that occluders cast on it, so that it doesn't have to
+// be lit when it's drawn.
+// Each of the box's faces gets a kBoxLightmapSize square of lightmap (with the
+// face's color already lit), and box is changed to draw with it instead of
+// its colors and lights, so lightmap has to outlive it.
+// Only directional lights cast shadows, and the lights can't change
+// afterwards without baking again.
+void bakeBoxLightmap(
+		Model& box,
+		Texture& lightmap,
+		const std::vector<AABB>& occluders,
+		const std::vector<Light>& lights);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef BUFFDOG_MAPPED_FILE
+#define BUFFDOG_MAPPED_FILE
+
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+#ifdef _WIN32
+#include "../util.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+// A file's contents, mapped into memory where that's possible, so that
+// reading it only pages in what's touched, without copying it.
+// Throws std::runtime_error if the file can't be read.
+struct MappedFile {
+	const char* data = nullptr;
+	size_t size = 0;
+
+	explicit MappedFile(const char* filename) {
+#ifdef _WIN32
+		this->contents = util::readFile(filename);
+		this->data = (const char*)this->contents.data();
+		this->size = this->contents.size();
+#else
+		int file = open(filename, O_RDONLY);
+
+		if (file < 0) {
+			throw std::runtime_error("failed to open file");
+		}
+
+		struct stat status;
+
+		if (fstat(file, &status) != 0) {
+			close(file);
+			throw std::runtime_error("failed to stat file");
+		}
+
+		this->size = status.st_size;
+
+		// mapping nothing fails, but there's nothing to parse either
+		if (this->size > 0) {
+			void* mapping = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, file, 0);
+
+			if (mapping == MAP_FAILED) {
+				close(file);
+				throw std::runtime_error("failed to map file");
+			}
+
+			// it's read from start to end
+			madvise(mapping, this->size, MADV_SEQUENTIAL);
+			this->data = (const char*)mapping;
+		}
+
+		// the mapping keeps the file open
+		close(file);
+#endif
+	}
+
+	~MappedFile() {
+#ifndef _WIN32
+		if (this->data) {
+			munmap((void*)this->data, this->size);
+		}
+#endif
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+#ifdef _WIN32
+private:
+	std::vector<unsigned char> contents;
+#endif
+};
+
+#endif
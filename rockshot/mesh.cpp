@@ -0,0 +1,247 @@
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#include "../vector.h"
+
+#include "mapped_file.h"
+#include "mesh.h"
+#include "mesh_optimizer.h"
+#include "obj.h"
+
+
+// every array starts on a multiple of 8 bytes, so that they can be read in
+// place from the mapped file
+static_assert(sizeof(MeshHeader) % 8 == 0, "MeshHeader must keep the arrays aligned");
+
+
+bool fitsIndex(size_t count) {
+	return count <= std::numeric_limits<uint32_t>::max();
+}
+
+// elements that a model has none of can still be referred to, e.g. normal 0
+// of an OBJ model without normals, but they're never read
+bool validIndex(uint32_t index, uint64_t count) {
+	return index < count || (count == 0 && index == 0);
+}
+
+bool saveMesh(const Model& model, const char* filename) {
+	if (!fitsIndex(model.vertices.size())
+			|| !fitsIndex(model.normals.size())
+			|| !fitsIndex(model.uvs.size())) {
+		return false;
+	}
+
+	MeshHeader header = {};
+	memcpy(header.magic, kMeshMagic, sizeof(header.magic));
+	header.byte_order = kMeshByteOrder;
+	header.version = kMeshVersion;
+	header.vertex_count = model.vertices.size();
+	header.normal_count = model.normals.size();
+	header.uv_count = model.uvs.size();
+	header.triangle_count = model.triangles.size();
+	header.translucency = model.translucency;
+	header.compute_lighting = model.compute_lighting;
+
+	Model bounded;
+	const Model* bounds = &model;
+
+	if (!model.has_bounds) {
+		bounded.vertices = model.vertices;
+		bounded.setBounds();
+		bounds = &bounded;
+	}
+
+	header.bounding_center[0] = bounds->bounding_center.x;
+	header.bounding_center[1] = bounds->bounding_center.y;
+	header.bounding_center[2] = bounds->bounding_center.z;
+	header.bounding_radius = bounds->bounding_radius;
+
+	std::vector<double> points;
+
+	for (auto& vertex : model.vertices) {
+		points.insert(points.end(), {vertex.x, vertex.y, vertex.z});
+	}
+
+	for (auto& normal : model.normals) {
+		points.insert(points.end(), {normal.x, normal.y, normal.z});
+	}
+
+	for (auto& uv : model.uvs) {
+		points.insert(points.end(), {uv.first, uv.second});
+	}
+
+	std::vector<MeshTriangle> triangles(model.triangles.size());
+
+	for (size_t i = 0; i < model.triangles.size(); i++) {
+		const Triangle3D& triangle = model.triangles[i];
+		MeshTriangle& mesh_triangle = triangles[i];
+		const Vertex* corners[3] = {&triangle.v0, &triangle.v1, &triangle.v2};
+
+		for (int corner = 0; corner < 3; corner++) {
+			mesh_triangle.vertices[corner] = corners[corner]->index;
+			mesh_triangle.normals[corner] = corners[corner]->normal;
+			mesh_triangle.uvs[corner] = corners[corner]->uv;
+			mesh_triangle.light_intensities[corner] = corners[corner]->light_intensity;
+		}
+
+		mesh_triangle.color[0] = triangle.color.x;
+		mesh_triangle.color[1] = triangle.color.y;
+		mesh_triangle.color[2] = triangle.color.z;
+		mesh_triangle.normal[0] = triangle.normal.x;
+		mesh_triangle.normal[1] = triangle.normal.y;
+		mesh_triangle.normal[2] = triangle.normal.z;
+		mesh_triangle.ignore_texture = triangle.ignore_texture;
+	}
+
+	FILE* file = fopen(filename, "wb");
+
+	if (!file) {
+		return false;
+	}
+
+	bool written =
+			fwrite(&header, sizeof(header), 1, file) == 1
+			&& fwrite(points.data(), sizeof(double), points.size(), file) == points.size()
+			&& fwrite(triangles.data(), sizeof(MeshTriangle), triangles.size(), file) == triangles.size();
+
+	return fclose(file) == 0 && written;
+}
+
+bool loadMesh(const char* filename, Model& model) {
+	try {
+		MappedFile file(filename);
+		MeshHeader header;
+
+		if (file.size < sizeof(header)) {
+			return false;
+		}
+
+		memcpy(&header, file.data, sizeof(header));
+
+		if (memcmp(header.magic, kMeshMagic, sizeof(header.magic)) != 0
+				|| header.byte_order != kMeshByteOrder
+				|| header.version != kMeshVersion) {
+			return false;
+		}
+
+		// each count is checked against the size first, so that the total can't
+		// overflow
+		uint64_t counts[4] = {
+				header.vertex_count, header.normal_count, header.uv_count, header.triangle_count};
+		uint64_t sizes[4] = {
+				3 * sizeof(double), 3 * sizeof(double), 2 * sizeof(double), sizeof(MeshTriangle)};
+		uint64_t expected_size = sizeof(header);
+
+		for (int i = 0; i < 4; i++) {
+			if (counts[i] > file.size / sizes[i]) {
+				return false;
+			}
+
+			expected_size += counts[i] * sizes[i];
+		}
+
+		if (expected_size != file.size) {
+			return false;
+		}
+
+		const double* vertices = (const double*)(file.data + sizeof(header));
+		const double* normals = vertices + 3 * header.vertex_count;
+		const double* uvs = normals + 3 * header.normal_count;
+		const MeshTriangle* triangles = (const MeshTriangle*)(uvs + 2 * header.uv_count);
+
+		// reserved rather than resized, so that each element is only written once
+		Model result;
+		result.vertices.reserve(header.vertex_count);
+		result.normals.reserve(header.normal_count);
+		result.uvs.reserve(header.uv_count);
+		result.triangles.reserve(header.triangle_count);
+
+		for (size_t i = 0; i < header.vertex_count; i++) {
+			result.vertices.push_back(Vector::point(
+					vertices[3 * i], vertices[3 * i + 1], vertices[3 * i + 2]));
+		}
+
+		for (size_t i = 0; i < header.normal_count; i++) {
+			result.normals.push_back(Vector::direction(
+					normals[3 * i], normals[3 * i + 1], normals[3 * i + 2]));
+		}
+
+		for (size_t i = 0; i < header.uv_count; i++) {
+			result.uvs.push_back(std::make_pair(uvs[2 * i], uvs[2 * i + 1]));
+		}
+
+		for (size_t i = 0; i < header.triangle_count; i++) {
+			const MeshTriangle& mesh_triangle = triangles[i];
+			Vertex corners[3];
+
+			for (int corner = 0; corner < 3; corner++) {
+				if (!validIndex(mesh_triangle.vertices[corner], header.vertex_count)
+						|| !validIndex(mesh_triangle.normals[corner], header.normal_count)
+						|| !validIndex(mesh_triangle.uvs[corner], header.uv_count)) {
+					return false;
+				}
+
+				corners[corner] = Vertex{
+						mesh_triangle.vertices[corner],
+						mesh_triangle.normals[corner],
+						mesh_triangle.uvs[corner],
+						mesh_triangle.light_intensities[corner]};
+			}
+
+			result.triangles.push_back(Triangle3D{
+					corners[0],
+					corners[1],
+					corners[2],
+					Vector::color(
+							mesh_triangle.color[0], mesh_triangle.color[1], mesh_triangle.color[2]),
+					Vector::direction(
+							mesh_triangle.normal[0], mesh_triangle.normal[1], mesh_triangle.normal[2]),
+					mesh_triangle.ignore_texture != 0});
+		}
+
+		result.translucency = header.translucency;
+		result.compute_lighting = header.compute_lighting != 0;
+		result.bounding_center = Vector::point(
+				header.bounding_center[0], header.bounding_center[1], header.bounding_center[2]);
+		result.bounding_radius = header.bounding_radius;
+		result.has_bounds = true;
+
+		model = std::move(result);
+
+		return true;
+	} catch (const std::runtime_error& error) {
+		return false;
+	}
+}
+
+Model loadModelFile(const char* obj_filename) {
+	std::filesystem::path mesh_filename(obj_filename);
+	mesh_filename.replace_extension(".mesh");
+
+	// a mesh without its OBJ file is fine, but one that's older than it is stale
+	std::error_code mesh_error;
+	std::error_code obj_error;
+	auto mesh_time = std::filesystem::last_write_time(mesh_filename, mesh_error);
+	auto obj_time = std::filesystem::last_write_time(obj_filename, obj_error);
+
+	if (!mesh_error && (obj_error || mesh_time >= obj_time)) {
+		Model model;
+
+		if (loadMesh(mesh_filename.string().c_str(), model)) {
+			return model;
+		}
+	}
+
+	Model model = parseOBJFile(obj_filename);
+
+#if OPTIMIZE_LOADED_MODELS
+	optimizeModel(model);
+#endif
+
+	return model;
+}
@@ -0,0 +1,61 @@
+#ifndef BUFFDOG_MESH
+#define BUFFDOG_MESH
+
+#include <cstdint>
+
+#include "model.h"
+
+
+// A binary copy of a Model's geometry, so that loading it is paging in the
+// file and copying arrays, instead of parsing text (see `make mesh`).
+// The file is a MeshHeader followed by the vertices, normals, uvs and
+// triangles, each an array of the types below.  Everything is in the byte
+// order of the machine that wrote it, which kMeshByteOrder catches.
+// A model's texture isn't part of it.
+
+constexpr char kMeshMagic[8] = {'B', 'D', 'M', 'E', 'S', 'H', '\0', '\0'};
+constexpr uint32_t kMeshByteOrder = 0x01020304;
+
+// bump this whenever the layout changes, so old files are ignored
+constexpr uint32_t kMeshVersion = 1;
+
+struct MeshHeader {
+	char magic[8];
+	uint32_t byte_order;
+	uint32_t version;
+
+	uint64_t vertex_count;
+	uint64_t normal_count;
+	uint64_t uv_count;
+	uint64_t triangle_count;
+
+	double bounding_center[3];
+	double bounding_radius;
+	int32_t translucency;
+	uint32_t compute_lighting;
+};
+
+struct MeshTriangle {
+	uint32_t vertices[3];
+	uint32_t normals[3];
+	uint32_t uvs[3];
+	float light_intensities[3];
+	float color[3];
+	float normal[3];
+	uint32_t ignore_texture;
+};
+
+// false if the model has more elements than 32 bit indices can refer to, or
+// the file couldn't be written
+bool saveMesh(const Model& model, const char* filename);
+
+// false, leaving model alone, if the file can't be read, or isn't a mesh
+// that this version wrote, or refers to elements it doesn't have
+bool loadMesh(const char* filename, Model& model);
+
+// loads the mesh with the same name as an OBJ file (e.g. city.mesh for
+// city.obj) if there's an up to date one, otherwise parses the OBJ file and
+// optimizes it (see optimizeModel()), which meshes from `make mesh` already are
+Model loadModelFile(const char* obj_filename);
+
+#endif
@@ -0,0 +1,75 @@
+// Converts OBJ files into binary meshes next to them (e.g. city.obj into
+// city.mesh), which loadModelFile() loads instead, see `make mesh`.
+// They're optimized first (see mesh_optimizer.h), and how much that helped is
+// printed along with how long they take to parse and load.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+
+#include "mesh.h"
+#include "mesh_optimizer.h"
+#include "model.h"
+#include "obj.h"
+
+
+typedef std::chrono::steady_clock converter_clock;
+
+double millisecondsSince(converter_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(converter_clock::now() - start).count();
+}
+
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		printf("usage: %s model.obj...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	for (int i = 1; i < argc; i++) {
+		std::filesystem::path mesh_filename(argv[i]);
+		mesh_filename.replace_extension(".mesh");
+
+		auto start = converter_clock::now();
+		Model model = parseOBJFile(argv[i]);
+		double parse_milliseconds = millisecondsSince(start);
+
+		MeshOptimization optimization = optimizeModel(model);
+
+		if (!saveMesh(model, mesh_filename.string().c_str())) {
+			printf("couldn't write %s!\n", mesh_filename.string().c_str());
+			return EXIT_FAILURE;
+		}
+
+		// make sure it reads back
+		Model loaded;
+		start = converter_clock::now();
+
+		if (!loadMesh(mesh_filename.string().c_str(), loaded)
+				|| loaded.triangles.size() != model.triangles.size()) {
+			printf("couldn't read back %s!\n", mesh_filename.string().c_str());
+			return EXIT_FAILURE;
+		}
+
+		printf(
+				"%s: %zu vertices, %zu triangles, %.2f ms to parse, %.2f ms to load as a mesh\n",
+				mesh_filename.string().c_str(),
+				model.vertices.size(),
+				model.triangles.size(),
+				parse_milliseconds,
+				millisecondsSince(start));
+		printf(
+				"    welded %zu vertices into %zu, %zu normals into %zu, %zu uvs into %zu, ACMR %.3f before, %.3f after\n",
+				optimization.vertices_before,
+				optimization.vertices_after,
+				optimization.normals_before,
+				optimization.normals_after,
+				optimization.uvs_before,
+				optimization.uvs_after,
+				optimization.acmr_before,
+				optimization.acmr_after);
+	}
+
+	return EXIT_SUCCESS;
+}
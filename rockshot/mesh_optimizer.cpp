@@ -0,0 +1,389 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mesh_optimizer.h"
+
+
+// the constants from Forsyth's article
+constexpr double kCacheDecayPower = 1.5;
+constexpr double kLastTriangleScore = 0.75;
+constexpr double kValenceBoostScale = 2.0;
+constexpr double kValenceBoostPower = 0.5;
+
+// a triangle or element that hasn't been found yet
+constexpr size_t kNone = SIZE_MAX;
+
+
+// an element's coordinates, with unused ones 0
+typedef std::array<double, 3> WeldKey;
+
+struct WeldKeyHash {
+	size_t operator()(const WeldKey& key) const {
+		size_t result = 0;
+
+		for (double value : key) {
+			uint64_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			result = (result ^ bits) * 0x100000001b3;
+		}
+
+		return result;
+	}
+};
+
+// compacts elements to the first of each set of equal ones, and returns
+// where each of the old ones went
+template <typename T, typename GetKey>
+std::vector<size_t> weldElements(std::vector<T>& elements, GetKey getKey) {
+	std::unordered_map<WeldKey, size_t, WeldKeyHash> firsts;
+	std::vector<size_t> remap(elements.size());
+	size_t kept = 0;
+
+	firsts.reserve(elements.size());
+
+	for (size_t i = 0; i < elements.size(); i++) {
+		WeldKey key = getKey(elements[i]);
+
+		// -0 and 0 are equal, but hash differently
+		for (double& value : key) {
+			value += 0.0;
+		}
+
+		auto inserted = firsts.insert(std::make_pair(key, kept));
+
+		if (inserted.second) {
+			elements[kept++] = elements[i];
+		}
+
+		remap[i] = inserted.first->second;
+	}
+
+	elements.resize(kept);
+
+	return remap;
+}
+
+// like weldElements(), but for renumbering in the order they're used, with
+// the unused ones after them
+template <typename T>
+void reorderElements(std::vector<T>& elements, std::vector<size_t>& remap, size_t used) {
+	for (size_t i = 0; i < remap.size(); i++) {
+		if (remap[i] == kNone) {
+			remap[i] = used++;
+		}
+	}
+
+	std::vector<T> reordered(elements.size());
+
+	for (size_t i = 0; i < elements.size(); i++) {
+		reordered[remap[i]] = elements[i];
+	}
+
+	elements = std::move(reordered);
+}
+
+// corners can refer to element 0 of a model that has none, see validIndex()
+// in mesh.cpp, so those are left alone
+void remapCorners(
+		Model& model,
+		const std::vector<size_t>& vertices,
+		const std::vector<size_t>& normals,
+		const std::vector<size_t>& uvs) {
+	for (auto& triangle : model.triangles) {
+		for (size_t corner = 0; corner < 3; corner++) {
+			Vertex& vertex = triangle.at(corner);
+
+			if (vertex.index < vertices.size()) {
+				vertex.index = vertices[vertex.index];
+			}
+
+			if (vertex.normal < normals.size()) {
+				vertex.normal = normals[vertex.normal];
+			}
+
+			if (vertex.uv < uvs.size()) {
+				vertex.uv = uvs[vertex.uv];
+			}
+		}
+	}
+}
+
+double averageCacheMissRatio(const Model& model, size_t cache_size) {
+	if (model.triangles.empty()) {
+		return 0;
+	}
+
+	// a FIFO cache, which a vertex is still in if fewer than cache_size misses
+	// have happened since it was fetched
+	std::vector<size_t> fetched_at(model.vertices.size(), kNone);
+	size_t misses = 0;
+
+	for (auto& triangle : model.triangles) {
+		for (size_t index : {triangle.v0.index, triangle.v1.index, triangle.v2.index}) {
+			if (index >= fetched_at.size()) {
+				continue;
+			}
+
+			if (fetched_at[index] == kNone || misses - fetched_at[index] >= cache_size) {
+				fetched_at[index] = misses;
+				misses++;
+			}
+		}
+	}
+
+	return (double)misses / model.triangles.size();
+}
+
+void weldModel(Model& model) {
+	std::vector<size_t> vertices = weldElements(model.vertices, [](const Vector& vertex) {
+		return WeldKey{vertex.x, vertex.y, vertex.z};
+	});
+	std::vector<size_t> normals = weldElements(model.normals, [](const Vector& normal) {
+		return WeldKey{normal.x, normal.y, normal.z};
+	});
+	std::vector<size_t> uvs = weldElements(model.uvs, [](const std::pair<double, double>& uv) {
+		return WeldKey{uv.first, uv.second, 0};
+	});
+
+	remapCorners(model, vertices, normals, uvs);
+	model.cached_lighting.clear();
+	model.positions.resize(0);
+}
+
+// how likely a vertex's triangles are to be drawn next: ones that were just
+// used score highest, unless they're the last triangle's (which has just
+// been drawn, so they all do equally well), and ones with few triangles left
+// are boosted so they don't get left behind
+double vertexScore(int cache_position, size_t remaining_triangles) {
+	if (remaining_triangles == 0) {
+		return -1;
+	}
+
+	double score = 0;
+
+	if (cache_position >= 0 && cache_position < 3) {
+		score = kLastTriangleScore;
+	} else if (cache_position >= 0) {
+		double scale = 1.0 / (kVertexCacheSize - 3);
+		score = pow(1.0 - (cache_position - 3) * scale, kCacheDecayPower);
+	}
+
+	return score + kValenceBoostScale * pow((double)remaining_triangles, -kValenceBoostPower);
+}
+
+void reorderTriangles(Model& model) {
+	size_t vertex_count = model.vertices.size();
+	size_t triangle_count = model.triangles.size();
+
+	if (vertex_count == 0 || triangle_count == 0) {
+		return;
+	}
+
+	auto corners = [&model](size_t triangle) {
+		const Triangle3D& t = model.triangles[triangle];
+		return std::array<size_t, 3>{t.v0.index, t.v1.index, t.v2.index};
+	};
+
+	// every vertex's triangles, the ones not drawn yet first
+	std::vector<size_t> remaining(vertex_count, 0);
+
+	for (size_t i = 0; i < triangle_count; i++) {
+		for (size_t vertex : corners(i)) {
+			if (vertex >= vertex_count) {
+				return;
+			}
+
+			remaining[vertex]++;
+		}
+	}
+
+	std::vector<size_t> first_triangle(vertex_count + 1, 0);
+
+	for (size_t i = 0; i < vertex_count; i++) {
+		first_triangle[i + 1] = first_triangle[i] + remaining[i];
+	}
+
+	std::vector<size_t> vertex_triangles(first_triangle[vertex_count]);
+	std::vector<size_t> filled(first_triangle.begin(), first_triangle.end() - 1);
+
+	for (size_t i = 0; i < triangle_count; i++) {
+		for (size_t vertex : corners(i)) {
+			vertex_triangles[filled[vertex]++] = i;
+		}
+	}
+
+	std::vector<int> cache_position(vertex_count, -1);
+	std::vector<double> vertex_scores(vertex_count);
+	std::vector<double> triangle_scores(triangle_count, 0);
+	std::vector<bool> drawn(triangle_count, false);
+
+	for (size_t i = 0; i < vertex_count; i++) {
+		vertex_scores[i] = vertexScore(-1, remaining[i]);
+	}
+
+	size_t best = 0;
+
+	for (size_t i = 0; i < triangle_count; i++) {
+		for (size_t vertex : corners(i)) {
+			triangle_scores[i] += vertex_scores[vertex];
+		}
+
+		if (triangle_scores[i] > triangle_scores[best]) {
+			best = i;
+		}
+	}
+
+	// the most recently used vertices first, with room for the three that
+	// each triangle pushes in before the oldest ones fall out
+	std::vector<size_t> cache;
+	std::vector<size_t> next_cache;
+	std::vector<Triangle3D> reordered;
+	size_t next_undrawn = 0;
+
+	cache.reserve(kVertexCacheSize + 3);
+	next_cache.reserve(kVertexCacheSize + 3);
+	reordered.reserve(triangle_count);
+
+	while (reordered.size() < triangle_count) {
+		// nothing around the cache is left, so start again from the next
+		// triangle in the old order
+		if (best == kNone) {
+			while (drawn[next_undrawn]) {
+				next_undrawn++;
+			}
+
+			best = next_undrawn;
+		}
+
+		drawn[best] = true;
+		reordered.push_back(model.triangles[best]);
+
+		std::array<size_t, 3> best_corners = corners(best);
+		next_cache.clear();
+
+		for (size_t vertex : best_corners) {
+			// take it out of the vertex's undrawn triangles
+			size_t* triangles = &vertex_triangles[first_triangle[vertex]];
+			size_t last = remaining[vertex] - 1;
+
+			std::swap(*std::find(triangles, triangles + last, best), triangles[last]);
+			remaining[vertex]--;
+
+			if (std::find(next_cache.begin(), next_cache.end(), vertex) == next_cache.end()) {
+				next_cache.push_back(vertex);
+			}
+		}
+
+		for (size_t vertex : cache) {
+			if (std::find(best_corners.begin(), best_corners.end(), vertex) == best_corners.end()) {
+				next_cache.push_back(vertex);
+			}
+		}
+
+		// rescore everything that moved in the cache, including the ones that
+		// just fell out of it, and pick the best triangle around them
+		best = kNone;
+		double best_score = -1;
+
+		for (size_t i = 0; i < next_cache.size(); i++) {
+			size_t vertex = next_cache[i];
+			cache_position[vertex] = i < kVertexCacheSize ? i : -1;
+
+			double score = vertexScore(cache_position[vertex], remaining[vertex]);
+			double change = score - vertex_scores[vertex];
+			vertex_scores[vertex] = score;
+
+			size_t* triangles = &vertex_triangles[first_triangle[vertex]];
+
+			for (size_t j = 0; j < remaining[vertex]; j++) {
+				triangle_scores[triangles[j]] += change;
+			}
+		}
+
+		for (size_t i = 0; i < next_cache.size() && i < kVertexCacheSize; i++) {
+			size_t vertex = next_cache[i];
+			size_t* triangles = &vertex_triangles[first_triangle[vertex]];
+
+			for (size_t j = 0; j < remaining[vertex]; j++) {
+				if (triangle_scores[triangles[j]] > best_score) {
+					best = triangles[j];
+					best_score = triangle_scores[triangles[j]];
+				}
+			}
+		}
+
+		next_cache.resize(std::min(next_cache.size(), kVertexCacheSize));
+		std::swap(cache, next_cache);
+	}
+
+	model.triangles = std::move(reordered);
+}
+
+void reorderVertices(Model& model) {
+	std::vector<size_t> vertices(model.vertices.size(), kNone);
+	std::vector<size_t> normals(model.normals.size(), kNone);
+	std::vector<size_t> uvs(model.uvs.size(), kNone);
+	size_t used_vertices = 0;
+	size_t used_normals = 0;
+	size_t used_uvs = 0;
+
+	auto use = [](std::vector<size_t>& remap, size_t index, size_t& used) {
+		if (index < remap.size() && remap[index] == kNone) {
+			remap[index] = used++;
+		}
+	};
+
+	for (auto& triangle : model.triangles) {
+		for (size_t corner = 0; corner < 3; corner++) {
+			Vertex& vertex = triangle.at(corner);
+
+			use(vertices, vertex.index, used_vertices);
+			use(normals, vertex.normal, used_normals);
+			use(uvs, vertex.uv, used_uvs);
+		}
+	}
+
+	reorderElements(model.vertices, vertices, used_vertices);
+	reorderElements(model.normals, normals, used_normals);
+	reorderElements(model.uvs, uvs, used_uvs);
+
+	remapCorners(model, vertices, normals, uvs);
+	model.cached_lighting.clear();
+	model.positions.resize(0);
+}
+
+MeshOptimization optimizeModel(Model& model) {
+	MeshOptimization result;
+	result.vertices_before = model.vertices.size();
+	result.normals_before = model.normals.size();
+	result.uvs_before = model.uvs.size();
+	result.acmr_before = averageCacheMissRatio(model);
+
+	weldModel(model);
+
+	// models that were already optimized for another cache can come out a
+	// little worse, so they're left alone
+	std::vector<Triangle3D> welded = model.triangles;
+	double welded_acmr = averageCacheMissRatio(model);
+
+	reorderTriangles(model);
+
+	if (averageCacheMissRatio(model) > welded_acmr) {
+		model.triangles = std::move(welded);
+	}
+
+	reorderVertices(model);
+
+	result.vertices_after = model.vertices.size();
+	result.normals_after = model.normals.size();
+	result.uvs_after = model.uvs.size();
+	result.acmr_after = averageCacheMissRatio(model);
+
+	return result;
+}
@@ -0,0 +1,61 @@
+#ifndef BUFFDOG_MESH_OPTIMIZER
+#define BUFFDOG_MESH_OPTIMIZER
+
+#include <cstddef>
+
+#include "model.h"
+
+
+// set this to 0 to keep loaded models' vertices and triangles in the order
+// their files had them, see loadModelFile()
+#ifndef OPTIMIZE_LOADED_MODELS
+#define OPTIMIZE_LOADED_MODELS 1
+#endif
+
+// the number of vertices that reorderTriangles() tries to keep triangles
+// within, and that averageCacheMissRatio() simulates
+constexpr size_t kVertexCacheSize = 32;
+
+
+struct MeshOptimization {
+	size_t vertices_before = 0;
+	size_t vertices_after = 0;
+	size_t normals_before = 0;
+	size_t normals_after = 0;
+	size_t uvs_before = 0;
+	size_t uvs_after = 0;
+
+	// see averageCacheMissRatio()
+	double acmr_before = 0;
+	double acmr_after = 0;
+};
+
+
+// The average cache miss ratio: how many vertices a triangle has to fetch
+// that aren't among the last cache_size fetched, from 3 for triangles that
+// share nothing down to about 0.5 for a grid.
+double averageCacheMissRatio(const Model& model, size_t cache_size = kVertexCacheSize);
+
+// Merges vertices, normals and texture coordinates that are exactly the same
+// as an earlier one, so each is transformed or lit once however many
+// triangles share it.  They're merged separately, since corners index them
+// separately, and the first copy's place is kept.
+void weldModel(Model& model);
+
+// Reorders the triangles so that each one shares as many vertices as it can
+// with the ones just before it, with Tom Forsyth's "Linear-Speed Vertex
+// Cache Optimisation": each vertex is scored by how recently it was used and
+// how few triangles are left that use it, and the next triangle is the best
+// scoring one around the last kVertexCacheSize vertices.
+void reorderTriangles(Model& model);
+
+// Renumbers the vertices, normals and texture coordinates in the order the
+// triangles first use them, so that drawing the triangles walks through them
+// instead of jumping around.  Unused ones go at the end.
+void reorderVertices(Model& model);
+
+// all three of the above, with how much they helped, though the triangles
+// keep their order if reordering them would raise the ACMR
+MeshOptimization optimizeModel(Model& model);
+
+#endif
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "../util.h"
 
 #include "model.h"
@@ -27,6 +29,99 @@ void Model::setTriangleNormals() {
 	}
 }
 
+void Model::setBounds() {
+	if (this->vertices.empty()) {
+		return;
+	}
+
+	Vector bbox_min = this->vertices[0];
+	Vector bbox_max = this->vertices[0];
+
+	for (auto& vertex : this->vertices) {
+		bbox_min = Vector::point(
+				std::min(bbox_min.x, vertex.x),
+				std::min(bbox_min.y, vertex.y),
+				std::min(bbox_min.z, vertex.z));
+		bbox_max = Vector::point(
+				std::max(bbox_max.x, vertex.x),
+				std::max(bbox_max.y, vertex.y),
+				std::max(bbox_max.z, vertex.z));
+	}
+
+	this->bounding_center = Vector::point(
+			(bbox_min.x + bbox_max.x) / 2,
+			(bbox_min.y + bbox_max.y) / 2,
+			(bbox_min.z + bbox_max.z) / 2);
+
+	double max_squared_distance = 0;
+
+	for (auto& vertex : this->vertices) {
+		max_squared_distance = std::max(
+				max_squared_distance,
+				vertex.subtract(this->bounding_center).squaredLength());
+	}
+
+	this->bounding_radius = sqrt(max_squared_distance);
+	this->has_bounds = true;
+}
+
+void Model::setTransformed(
+		const Model& source,
+		const AffineTransform& vertex_transform,
+		const AffineTransform& normal_transform) {
+	// copy assigning a vector only allocates if it's smaller than the source
+	this->uvs = source.uvs;
+	this->triangles = source.triangles;
+	this->texture = source.texture;
+	this->has_texture = source.has_texture;
+	this->compute_lighting = source.compute_lighting;
+	this->initial_rotation = source.initial_rotation;
+	this->translucency = source.translucency;
+	this->cached_lighting_generation = 0;
+
+	// the float positions only go on to the camera, physics works with the
+	// vertices, so they're transformed again as doubles
+	transformPoints(vertex_transform, source.positionStream(), this->positions);
+
+	this->vertices.resize(source.vertices.size());
+
+	for (size_t i = 0; i < source.vertices.size(); i++) {
+		this->vertices[i] = vertex_transform.transformPoint(source.vertices[i]);
+	}
+
+	this->normals.resize(source.normals.size());
+
+	for (size_t i = 0; i < source.normals.size(); i++) {
+		this->normals[i] = normal_transform.transformDirection(source.normals[i]);
+	}
+
+	for (auto& triangle : this->triangles) {
+		triangle.normal = normal_transform.transformDirection(triangle.normal);
+	}
+
+	if (!source.has_bounds) {
+		this->setBounds();
+		return;
+	}
+
+	// the radius grows with the largest scale along any axis
+	double max_squared_scale = 0;
+
+	for (int column = 0; column < 3; column++) {
+		double squared_scale = 0;
+
+		for (int row = 0; row < 3; row++) {
+			squared_scale += vertex_transform.at(row, column) * vertex_transform.at(row, column);
+		}
+
+		max_squared_scale = std::max(max_squared_scale, squared_scale);
+	}
+
+	this->bounding_center = vertex_transform.transformPoint(source.bounding_center);
+	this->bounding_radius = source.bounding_radius * sqrt(max_squared_scale);
+	this->has_bounds = true;
+}
+
 #define MAX_COLOR_VAL 0.9
 #define MIN_COLOR_VAL 0.0
 
@@ -141,6 +236,7 @@ Model Model::buildHexahedron(Vector box_min, Vector box_max) {
 	};
 
 	item.setTriangleNormals();
+	item.setBounds();
 
 	return item;
 }
@@ -197,6 +293,7 @@ Model Model::buildTetrahedron() {
 					purple}};
 
 	item.setTriangleNormals();
+	item.setBounds();
 
 	// keep it pointing up
 	item.initial_rotation = Vector::direction(0, 0, 0);
@@ -379,6 +476,7 @@ Model Model::buildIcosahedron() {
 		};
 
 	item.setTriangleNormals();
+	item.setBounds();
 
 	item.compute_lighting = false;
 
@@ -459,6 +557,7 @@ Model subdivide(Model model) {
 	model.triangles = std::move(new_triangles);
 
 	model.setTriangleNormals();
+	model.setBounds();
 
 	return model;
 }
@@ -1,13 +1,16 @@
 #ifndef BUFFDOG_MODEL
 #define BUFFDOG_MODEL
 
+#include <cstdint>
 #include <vector>
 #include <utility>
 
+#include "../matrix.h"
 #include "../vector.h"
 
 #include "texture.h"
 #include "triangle.h"
+#include "vertex_stream.h"
 
 
 // Logic for drawing models
@@ -73,10 +76,55 @@ struct Model {
 
 	int translucency = 0;
 
+	// a sphere around all of the vertices, so that whole models can be culled
+	// without looking at their triangles, see setBounds()
+	Vector bounding_center = Vector::origin();
+	double bounding_radius = 0;
+	bool has_bounds = false;
+
+	// the lighting of each normal (or each triangle, if there aren't any) for
+	// static models, which is only found again when the renderer's lights
+	// change, see Renderer::lightModel()
+	// it's not part of what the model looks like, so const models can fill it
+	mutable std::vector<double> cached_lighting;
+	mutable uint64_t cached_lighting_generation = 0;
+
+	// the vertices as floats, for transforming all of them at once, see
+	// positionStream()
+	mutable VertexStream positions;
+
+	// positions, filled from the vertices the first time they're needed
+	// (setTransformed() fills them as it goes), so anything that changes the
+	// vertices without changing how many there are has to call
+	// positions.setPoints() itself
+	const VertexStream& positionStream() const {
+		if (this->positions.size() != this->vertices.size()) {
+			this->positions.setPoints(this->vertices);
+		}
+
+		return this->positions;
+	}
+
 	// TODO: does precomputing triangle normals make sense?
 	// maybe not, but it's hard to do otherwise sadly
 	void setTriangleNormals();
 
+	// centers the bounding sphere on the middle of the vertices' bounding box,
+	// which is simple and close enough for culling
+	void setBounds();
+
+	// makes this a copy of source with its vertices and normals transformed,
+	// reusing this model's memory, so that doing it every frame doesn't allocate
+	// once it's big enough
+	// the vertices keep their double precision for physics, and positions are
+	// transformed separately as floats for the renderer (see transformPoints())
+	// source's bounding sphere is transformed too, or found from scratch if it
+	// doesn't have one, and any cached lighting is thrown out
+	void setTransformed(
+			const Model& source,
+			const AffineTransform& vertex_transform,
+			const AffineTransform& normal_transform);
+
 	void setTexture(Texture* texture) {
 		this->texture = texture;
 		this->has_texture = true;
@@ -0,0 +1,306 @@
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../device.h"
+#include "../vector.h"
+
+#include "mapped_file.h"
+#include "obj.h"
+
+
+// chunks smaller than this aren't worth starting a thread for
+constexpr size_t kMinOBJChunkBytes = 1 << 20;
+
+// the longest number that's parsed without std::from_chars, see parseDouble()
+constexpr size_t kMaxNumberLength = 64;
+
+
+// a run of whole lines that one thread parses
+struct OBJChunk {
+	const char* begin;
+	const char* end;
+
+	// how many of each element are in the chunk, see countOBJChunk(), then
+	// where its first ones go in the model
+	size_t vertices = 0;
+	size_t normals = 0;
+	size_t uvs = 0;
+	size_t triangles = 0;
+};
+
+
+inline bool isBlank(char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline const char* skipBlanks(const char* p, const char* end) {
+	while (p < end && isBlank(*p)) {
+		p++;
+	}
+
+	return p;
+}
+
+inline const char* skipToken(const char* p, const char* end) {
+	while (p < end && !isBlank(*p)) {
+		p++;
+	}
+
+	return p;
+}
+
+inline const char* lineEnd(const char* p, const char* end) {
+	const char* newline = (const char*)memchr(p, '\n', end - p);
+
+	return newline ? newline : end;
+}
+
+// the lines that matter start with a keyword and a blank
+inline bool startsWith(const char* p, const char* end, const char* keyword) {
+	size_t length = strlen(keyword);
+
+	return (size_t)(end - p) > length && memcmp(p, keyword, length) == 0 && isBlank(p[length]);
+}
+
+// anything that isn't a number is read as 0
+const char* parseDouble(const char* p, const char* end, double& value) {
+	p = skipBlanks(p, end);
+
+	// from_chars doesn't take a leading +
+	if (p < end && *p == '+') {
+		p++;
+	}
+
+	value = 0;
+
+#ifdef __cpp_lib_to_chars
+	std::from_chars_result result = std::from_chars(p, end, value);
+
+	if (result.ec != std::errc()) {
+		value = 0;
+	}
+#else
+	// strtod needs a null terminated string, which the mapped file isn't
+	char number[kMaxNumberLength];
+	size_t length = std::min((size_t)(skipToken(p, end) - p), kMaxNumberLength - 1);
+
+	memcpy(number, p, length);
+	number[length] = '\0';
+	value = strtod(number, nullptr);
+#endif
+
+	return skipToken(p, end);
+}
+
+// OBJ indices start at 1, and negative ones count back from the end of what's
+// been defined so far (-1 is the last one)
+// 0 if there isn't one
+const char* parseIndex(const char* p, const char* end, size_t defined, size_t& index) {
+	long value = 0;
+	std::from_chars_result result = std::from_chars(p, end, value);
+
+	if (result.ec != std::errc()) {
+		index = 0;
+		return p;
+	}
+
+	if (value > 0) {
+		index = value - 1;
+	} else if (value < 0 && (size_t)-value <= defined) {
+		index = defined + value;
+	} else {
+		index = 0;
+	}
+
+	return result.ptr;
+}
+
+// the number of corners of the face on the line that starts at p
+int countCorners(const char* p, const char* end) {
+	int corners = 0;
+
+	for (p = skipBlanks(p, end); p < end; p = skipBlanks(skipToken(p, end), end)) {
+		corners++;
+	}
+
+	return corners;
+}
+
+void countOBJChunk(OBJChunk& chunk) {
+	for (const char* line = chunk.begin; line < chunk.end;) {
+		const char* end = lineEnd(line, chunk.end);
+		const char* p = skipBlanks(line, end);
+
+		if (startsWith(p, end, "v")) {
+			chunk.vertices++;
+		} else if (startsWith(p, end, "vn")) {
+			chunk.normals++;
+		} else if (startsWith(p, end, "vt")) {
+			chunk.uvs++;
+		} else if (startsWith(p, end, "f")) {
+			int corners = countCorners(p + 1, end);
+
+			if (corners >= 3) {
+				chunk.triangles += corners - 2;
+			}
+		}
+
+		line = end + 1;
+	}
+}
+
+// fills in the chunk's part of model, which has already been sized for
+// every chunk's elements
+void parseOBJChunk(const OBJChunk& chunk, Model& model) {
+	size_t vertex = chunk.vertices;
+	size_t normal = chunk.normals;
+	size_t uv = chunk.uvs;
+	size_t triangle = chunk.triangles;
+	std::vector<Vertex> corners;
+
+	for (const char* line = chunk.begin; line < chunk.end;) {
+		const char* end = lineEnd(line, chunk.end);
+		const char* p = skipBlanks(line, end);
+
+		if (startsWith(p, end, "v")) {
+			double x, y, z;
+			p = parseDouble(p + 1, end, x);
+			p = parseDouble(p, end, y);
+			parseDouble(p, end, z);
+
+			model.vertices[vertex++] = Vector::point(x, y, z);
+		} else if (startsWith(p, end, "vn")) {
+			double x, y, z;
+			p = parseDouble(p + 2, end, x);
+			p = parseDouble(p, end, y);
+			parseDouble(p, end, z);
+
+			model.normals[normal++] = Vector::direction(x, y, z);
+		} else if (startsWith(p, end, "vt")) {
+			double u, v;
+			p = parseDouble(p + 2, end, u);
+			parseDouble(p, end, v);
+
+			model.uvs[uv++] = std::make_pair(u, v);
+		} else if (startsWith(p, end, "f")) {
+			corners.clear();
+
+			// v, v/vt, v//vn or v/vt/vn
+			for (p = skipBlanks(p + 1, end); p < end; p = skipBlanks(skipToken(p, end), end)) {
+				Vertex corner = {0, 0, 0, 1.0};
+				const char* q = parseIndex(p, end, vertex, corner.index);
+
+				if (q < end && *q == '/') {
+					q = parseIndex(q + 1, end, uv, corner.uv);
+
+					if (q < end && *q == '/') {
+						parseIndex(q + 1, end, normal, corner.normal);
+					}
+				}
+
+				corners.push_back(corner);
+			}
+
+			for (size_t i = 1; i + 1 < corners.size(); i++) {
+				model.triangles[triangle++] = Triangle3D{
+						corners[0],
+						corners[i],
+						corners[i + 1],
+						Vector::color(0.8, 0.8, 0.8)};
+			}
+		}
+
+		line = end + 1;
+	}
+}
+
+// runs work on each chunk, each on its own thread apart from the first, which
+// is run on this one
+template <typename Work>
+void forEachChunk(std::vector<OBJChunk>& chunks, Work work) {
+	std::vector<std::thread> threads;
+
+	for (size_t i = 1; i < chunks.size(); i++) {
+		threads.emplace_back(work, std::ref(chunks[i]));
+	}
+
+	work(chunks[0]);
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
+
+Model parseOBJFile(const char* filename, unsigned int thread_count) {
+	Model result;
+
+	try {
+		MappedFile file(filename);
+
+		if (thread_count == 0) {
+			thread_count = std::max(1u, std::thread::hardware_concurrency());
+		}
+
+		// small files are parsed in one go
+		size_t chunk_count = std::min((size_t)thread_count, file.size / kMinOBJChunkBytes + 1);
+		const char* file_end = file.data + file.size;
+		std::vector<OBJChunk> chunks(chunk_count);
+
+		// each chunk ends after the first line break past its share of the file
+		for (size_t i = 0; i < chunk_count; i++) {
+			chunks[i].begin = i == 0 ? file.data : chunks[i - 1].end;
+			chunks[i].end = i + 1 == chunk_count
+					? file_end
+					: std::min(file_end, lineEnd(file.data + file.size * (i + 1) / chunk_count, file_end) + 1);
+
+			if (chunks[i].end < chunks[i].begin) {
+				chunks[i].end = chunks[i].begin;
+			}
+		}
+
+		forEachChunk(chunks, countOBJChunk);
+
+		// turn the counts into where each chunk starts
+		size_t vertices = 0;
+		size_t normals = 0;
+		size_t uvs = 0;
+		size_t triangles = 0;
+
+		for (auto& chunk : chunks) {
+			OBJChunk counts = chunk;
+
+			chunk.vertices = vertices;
+			chunk.normals = normals;
+			chunk.uvs = uvs;
+			chunk.triangles = triangles;
+
+			vertices += counts.vertices;
+			normals += counts.normals;
+			uvs += counts.uvs;
+			triangles += counts.triangles;
+		}
+
+		result.vertices.resize(vertices);
+		result.normals.resize(normals);
+		result.uvs.resize(uvs);
+		result.triangles.resize(triangles);
+
+		forEachChunk(chunks, [&result](const OBJChunk& chunk) { parseOBJChunk(chunk, result); });
+	} catch (const std::runtime_error& error) {
+		char message[256];
+		snprintf(message, sizeof(message), "couldn't read obj file %s\n", filename);
+
+		terminateFatal(message);
+	}
+
+	result.setBounds();
+
+	return result;
+}
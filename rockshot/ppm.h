@@ -3,6 +3,7 @@
 
 #include <cstdlib>
 
+#include "../device.h"
 #include "../vector.h"
 
 #include "texture.h"
@@ -138,18 +139,20 @@ ppm_info_t readPPMFile(const char* filename) {
 struct PPMTexture : public Texture {
 	ppm_info_t ppm_info;
 
-	Vector vectorColorFromUV(double u, double v) override {
-		int x = (ppm_info.width - 1) * u;
-		int y = (ppm_info.height - 1) * (1.0 - v);
-
-		return ppm_info.colors[ppm_info.width * y + x];
-	}
-
 	static PPMTexture load(const char* filename) {
 		PPMTexture result;
 
 		result.ppm_info = readPPMFile(filename);
 
+		ppm_info_t& info = result.ppm_info;
+
+		// the image's top row is at v = 1
+		result.setTexels(info.width, info.height, [&info](int x, int y) {
+			Vector& color = info.colors[info.width * (info.height - 1 - y) + x];
+
+			return device::getColorValue(color.x, color.y, color.z);
+		});
+
 		return result;
 	}
 };
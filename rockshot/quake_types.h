@@ -1,3 +1,9 @@
+#ifndef BUFFDOG_QUAKE_TYPES
+#define BUFFDOG_QUAKE_TYPES
+
+#include <cstdio>
+
+
 struct vec3_t {
 	float x;
 	float y;
@@ -168,3 +174,34 @@ typedef struct {
 	short start_vertex;
 	short end_vertex;
 } edge_t;
+
+
+// children and leaves are the BSP tree, nodes at bsp_header_t.nodes
+typedef struct {
+	int plane_id;                // The plane that splits the node
+															 //   must be in [0,numplanes)
+	short children[2];           // front and back child nodes, or if negative,
+															 //   the leaf -(children[i] + 1)
+	short mins[3];               // bounding box of the node and its children
+	short maxs[3];
+	unsigned short first_face;   // the faces that lie on the node's plane
+	unsigned short face_count;
+} node_t;
+
+
+// leaf contents
+#define CONTENTS_EMPTY -1
+#define CONTENTS_SOLID -2
+
+typedef struct {
+	int contents;                // CONTENTS_EMPTY, CONTENTS_SOLID, water, etc.
+	int vislist;                 // offset into the visilist, or -1 for no
+															 //   visibility list (everything is visible)
+	short mins[3];               // bounding box of the leaf
+	short maxs[3];
+	unsigned short face_list_id; // first index into the face list
+	unsigned short face_count;   // number of faces in the face list
+	unsigned char ambient_level[4]; // ambient sounds
+} leaf_t;
+
+#endif
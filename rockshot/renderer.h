@@ -1,29 +1,49 @@
 #ifndef BUFFDOG_RENDERER
 #define BUFFDOG_RENDERER
 
+#include <algorithm>
 #include <array>
+#include <memory>
 #include <vector>
 
 #include "../device.h"
 #include "../matrix.h"
 #include "../vector.h"
 
+#include "bsp_world.h"
 #include "entity.h"
 #include "model.h"
 #include "scene.h"
+#include "scratch_buffer.h"
+#include "span_buffer.h"
+#include "tile_rasterizer.h"
 #include "triangle.h"
+#include "vertex_stream.h"
 
 #define NUM_FRUSTUM_PLANES 6
+// the guard band's side planes come after the frustum's, see
+// Renderer::guard_band
+#define NUM_GUARD_BAND_PLANES 4
+#define NUM_CLIP_PLANES (NUM_FRUSTUM_PLANES + NUM_GUARD_BAND_PLANES)
 // the max potential vertices for a triangle clipped against six planes is 9
+// (with the guard band, it's still only ever clipped against six)
 #define MAX_CLIPPED_POLYGON_VERTICES 9
 
-// Visual C++ is unhappy with dynamic automatic array sizes, so I'll just do
-// this for now.  This is effectively the upper limit on the number of vertices
-// that can be displayed
-#define TEMP_ARRAY_SIZE 4096
+// how much bigger than the screen the guard band is, in each dimension
+// 1.5 keeps the bounding box of anything inside it small enough for
+// fillEdgeFunction()'s 32 bit edge functions at the default resolution
+#define GUARD_BAND_SCALE 1.5
 
-// set this to 1 to draw triangles with the fillBarycentric method
-#define USE_BARYCENTRIC 0
+// set this to 0 to draw each triangle as soon as it's projected, instead of
+// queueing them up for the multithreaded TileRasterizer
+#ifndef USE_TILED_RASTERIZER
+#define USE_TILED_RASTERIZER 1
+#endif
+
+// set this to 1 to log RenderStats once per second
+#ifndef LOG_RENDER_STATS
+#define LOG_RENDER_STATS 0
+#endif
 
 
 
@@ -37,46 +57,208 @@ struct ClippedPolygon {
 };
 
 
+// counts for the last frame drawn by Renderer::drawScene()
+struct RenderStats {
+	int models_drawn = 0;
+	int models_culled = 0; // entirely outside the frustum, see Renderer::cull_models
+	int world_faces_drawn = 0; // in the PVS and facing the camera, see BSPWorld
+
+	// pixels shaded per pixel on screen, or -1 when built with COUNT_OVERDRAW
+	// set to 0, since nothing is counted then
+	double overdraw = 0;
+
+	// rejected by the hierarchical z buffer, see occludedTriangleCount()
+	int triangles_occluded = 0;
+
+	int static_spans_drawn = 0; // see Renderer::use_span_buffer
+};
+
+
+// a model waiting to be drawn by Renderer::drawScene(), see
+// Renderer::sort_models
+struct QueuedModel {
+	const Model* model;
+	int translucency;
+	bool is_static;
+	double depth; // the camera space z of its bounding sphere's center
+};
+
+
 struct Renderer {
-	Vector frustum_planes[NUM_FRUSTUM_PLANES];
-	Matrix camera_matrix;
+	// near, left, right, high, low, far, then the guard band's left, right,
+	// high and low
+	Vector frustum_planes[NUM_CLIP_PLANES];
+	AffineTransform camera_matrix;
+	std::unique_ptr<TileRasterizer> tile_rasterizer;
+
+	// scanline filling can't be split into tiles, so those triangles are always
+	// drawn immediately
+	FillMethod fill_method = FillMethod::edge_function;
+
+	// see Triangle2D::perspective_span, 16 is what Quake did
+	int perspective_span = 16;
+
+	// Triangles that cross the sides of the frustum are only clipped if they
+	// also reach outside of the guard band, a bigger frustum around it.  The
+	// rasterizers only draw what's on screen anyway, so this saves clipping
+	// and drawing the extra triangles that clipping splits polygons into.
+	// Crossing the near and far planes always has to be clipped.
+	bool guard_band = true;
+
+	// skip models whose bounding sphere (see Model::setBounds()) is entirely
+	// outside the frustum, without transforming or looking at their triangles
+	bool cull_models = true;
+
+	// Draw opaque models nearest first, so that whatever they cover fails the
+	// depth test before it's shaded, then translucent ones farthest first.
+	// Otherwise models are drawn in the order they were added to the scene.
+	bool sort_models = true;
+
+	// Draw the world and static opaque models through the span buffer, which
+	// shades each of their pixels once, however many of their triangles are
+	// behind each other (see SpanBuffer).  Everything else is drawn over them
+	// as usual.
+	// Static models must not pass through each other or the world.
+	bool use_span_buffer = false;
+
+	// keep static models' lighting between frames, until the lights change,
+	// instead of lighting every model every frame (see lightModel())
+	bool cache_static_lighting = true;
+
+	// while this is set, drawTriangle() sends triangles to span_buffer
+	bool drawing_static = false;
+	SpanBuffer span_buffer;
+
+	RenderStats stats;
+
+	// the camera space vertices of the model being drawn, see transformToCamera()
+	// this is kept between models and frames, so that once it's grown to fit
+	// the biggest model, drawing doesn't allocate anything
+	VertexStream camera_vertices;
+
+	// the lighting of each of the model's normals (or each triangle, if it
+	// doesn't have normals), see lightModel()
+	// null for models that are lit a triangle at a time, as they're drawn
+	const double* model_lighting = nullptr;
+	ScratchBuffer<double> normal_lighting;
+
+	// the lights that static models' cached lighting was found with, and a
+	// count of how many times they've changed, see Model::cached_lighting
+	std::vector<Light> cached_lights;
+	uint64_t lighting_generation = 1;
+
+	// each of the model's vertices' frustumOutcode(), and where it is on
+	// screen (see projectVertexToSubpixels()) if it doesn't need clipping
+	ScratchBuffer<uint16_t> vertex_outcodes;
+	ScratchBuffer<Point> vertex_projections;
+
+	// this frame's models, kept between frames like the buffers above
+	std::vector<QueuedModel> opaque_models;
+	std::vector<QueuedModel> translucent_models;
+	std::vector<QueuedModel> static_models;
 
 	static Renderer create(Viewport& viewport) {
 		Renderer renderer;
 
-		// TODO: determine these dynamically from viewport
-		// the x value for the right plane and the y value for the high plane are a
-		// little off because otherwise the clipTriangle function would try to draw out
-		// of bounds
-		renderer.frustum_planes[0] = {0, 0, -1, viewport.near_plane_distance}; // near plane
-		renderer.frustum_planes[1] = {0.7071, 0, -0.7071, 0}; // left plane
-		renderer.frustum_planes[2] = {-0.70712, 0, -0.7071, 0}; // right plane
-		renderer.frustum_planes[3] = {0, -0.801, -0.6, 0}; // high plane
-		renderer.frustum_planes[4] = {0, 0.8, -0.6, 0}; // low plane
-		renderer.frustum_planes[5] = {0, 0, 1, -viewport.far_plane_distance}; // far plane
+		renderer.setUpFrustumPlanes(viewport);
+		renderer.setRasterThreads(RASTER_THREADS);
 
 		return renderer;
 	}
 
-	// void setUpFrustumPlanes() {
-	// 	// near plane
-	// 	this->frustum_planes[0] = {0, 0, 1, -viewport.distance};
-	// 	// far plane
-	// 	this->frustum_planes[1] = {0, 0, 1, viewport.far_plane_distance};
-	// }
+	// 0 means one thread per hardware thread, see RASTER_THREADS
+	void setRasterThreads(unsigned int thread_count) {
+		this->tile_rasterizer = std::make_unique<TileRasterizer>(thread_count);
+	}
+
+	// the side planes pass through the camera and the edges of the viewport, so
+	// they follow its aspect ratio.  The right and high planes are pulled in by
+	// one pixel, because a vertex exactly on those edges would project to x_res
+	// or y_res, which is out of bounds.
+	// this depends on the current resolution, so it should be called again
+	// whenever that changes
+	void setUpFrustumPlanes(Viewport& viewport) {
+		double distance = fabs(viewport.distance);
+		double half_width = viewport.width / 2;
+		double half_height = viewport.height / 2;
+		double pixel_width = viewport.width / device::getXRes();
+		double pixel_height = viewport.height / device::getYRes();
+
+		this->frustum_planes[0] = {0, 0, -1, viewport.near_plane_distance}; // near plane
+		this->frustum_planes[1] = Vector::direction(
+				distance, 0, -half_width).unit(); // left plane
+		this->frustum_planes[2] = Vector::direction(
+				-distance, 0, -(half_width - pixel_width)).unit(); // right plane
+		this->frustum_planes[3] = Vector::direction(
+				0, -distance, -(half_height - pixel_height)).unit(); // high plane
+		this->frustum_planes[4] = Vector::direction(
+				0, distance, -half_height).unit(); // low plane
+		this->frustum_planes[5] = {0, 0, 1, -viewport.far_plane_distance}; // far plane
+
+		double guard_half_width = half_width * GUARD_BAND_SCALE;
+		double guard_half_height = half_height * GUARD_BAND_SCALE;
+
+		this->frustum_planes[6] = Vector::direction(
+				distance, 0, -guard_half_width).unit(); // guard band left plane
+		this->frustum_planes[7] = Vector::direction(
+				-distance, 0, -guard_half_width).unit(); // guard band right plane
+		this->frustum_planes[8] = Vector::direction(
+				0, -distance, -guard_half_height).unit(); // guard band high plane
+		this->frustum_planes[9] = Vector::direction(
+				0, distance, -guard_half_height).unit(); // guard band low plane
+	}
 
 	bool insidePlane(Vector vertex, Vector plane) {
 		return vertex.dotProduct(plane) > 0.0;
 	}
 
+	// one bit for each plane that the vertex is outside of, bit i for
+	// frustum_planes[i]
+	// a triangle is entirely outside if its vertices' outcodes have a bit in
+	// common, otherwise it only needs clipping against the clipPlanes() in any
+	// of them
+	int frustumOutcode(Vector vertex) {
+		int outcode = 0;
+
+		for (int i = 0; i < NUM_CLIP_PLANES; i++) {
+			if (!insidePlane(vertex, this->frustum_planes[i])) {
+				outcode |= 1 << i;
+			}
+		}
+
+		return outcode;
+	}
+
+	// the planes in outcode that have to be clipped against, see guard_band
+	int clipPlanes(int outcode) {
+		constexpr int kFrustumPlanes = (1 << NUM_FRUSTUM_PLANES) - 1;
+		constexpr int kGuardBandPlanes =
+				(1 << 0) | (1 << 5) | (((1 << NUM_GUARD_BAND_PLANES) - 1) << NUM_FRUSTUM_PLANES);
+
+		return outcode & (this->guard_band ? kGuardBandPlanes : kFrustumPlanes);
+	}
+
 	bool insideFrustum(Vector vertex) {
+		return (frustumOutcode(vertex) & ((1 << NUM_FRUSTUM_PLANES) - 1)) == 0;
+	}
+
+	// true if the model's bounding sphere is entirely outside one of the
+	// frustum planes, which are all normalized, so the dot product is the
+	// distance from the plane
+	bool isOutsideFrustum(const Model& model) {
+		if (!model.has_bounds) {
+			return false;
+		}
+
+		Vector center = this->camera_matrix.transformPoint(model.bounding_center);
+
 		for (int i = 0; i < NUM_FRUSTUM_PLANES; i++) {
-			if (!insidePlane(vertex, this->frustum_planes[i])) {
-				return false;
+			if (center.dotProduct(this->frustum_planes[i]) < -model.bounding_radius) {
+				return true;
 			}
 		}
 
-		return true;
+		return false;
 	}
 
 	Vector linePlaneIntersection(Vector v1, Vector v2, Vector plane) {
@@ -100,122 +282,112 @@ struct Renderer {
 		return viewportToCanvas(x, y, viewport.width, viewport.height);
 	}
 
+	// like projectVertexToScreen(), but in fixed point with SUBPIXEL_BITS
+	// fractional bits, see Triangle2D::s0
+	Point projectVertexToSubpixels(const Vector& vertex, const Viewport& viewport) {
+		double scale = 1 << SUBPIXEL_BITS;
+		double x = vertex.x * viewport.distance / vertex.z;
+		double y = vertex.y * viewport.distance / vertex.z;
+
+		return Point{
+				(int)floor((x * device::getXRes() / viewport.width + device::getXRes() / 2) * scale),
+				(int)floor((y * device::getYRes() / viewport.height + device::getYRes() / 2) * scale)};
+	}
+
 	// drawing
 
 	// Sutherland-Hodgman algorithm
-	ClippedPolygon clipTriangle(ClippedPolygon triangle) {
-		ClippedPolygon temp_poly = {{}, {}, {}, {}, 0};
-
-		ClippedPolygon* original_poly = &triangle;
-		ClippedPolygon* new_poly = &temp_poly;
+	// clips polygon against just the frustum planes in planes (see
+	// frustumOutcode()), since the others can't cut it, going back and forth
+	// between polygon and scratch instead of copying
+	// returns whichever of the two ends up with the result, which has no
+	// vertices if it was clipped out of existence
+	ClippedPolygon* clipTriangle(
+			ClippedPolygon* polygon, ClippedPolygon* scratch, int planes) {
+		ClippedPolygon* original_poly = polygon;
+		ClippedPolygon* new_poly = scratch;
+
+		// clip against each crossed frustum plane
+		for (int i = 0; i < NUM_CLIP_PLANES; i++) {
+			if (!(planes & (1 << i))) {
+				continue;
+			}
 
-		int new_poly_vertex_count = 0;
+			Vector& plane = this->frustum_planes[i];
+			int new_poly_vertex_count = 0;
+			size_t previous = original_poly->vertex_count - 1;
 
-		// clip against each frustum plane
-		for (int i = 0; i < NUM_FRUSTUM_PLANES; i++) {
-			new_poly_vertex_count = 0;
-			int previous = original_poly->vertex_count - 1;
-			int current = 0;
+			// each vertex's distance from the plane is needed twice, as the
+			// current vertex and then as the previous one
+			double previous_distance = original_poly->vertices[previous].dotProduct(plane);
 
 			// step through each pair of vertices, deciding what to do based on whether
 			// each is inside or outside the given plane
-			while (current < original_poly->vertex_count) {
+			for (size_t current = 0; current < original_poly->vertex_count; current++) {
 				Vector& v1 = original_poly->vertices[previous];
 				Vector& v2 = original_poly->vertices[current];
-				Vector& plane = this->frustum_planes[i];
-
-				double& s1 = original_poly->shades[previous];
-				double& s2 = original_poly->shades[current];
-
-				double vt_u1 = original_poly->u_values[previous];
-				double vt_v1 = original_poly->v_values[previous];
-
-				double vt_u2 = original_poly->u_values[current];
-				double vt_v2 = original_poly->v_values[current];
 
-				#define addCurrentVertex(vertex, vt_u, vt_v) \
-						new_poly->vertices[new_poly_vertex_count] = vertex; \
-						new_poly->shades[new_poly_vertex_count] = \
-								original_poly->shades[current]; \
-						new_poly->u_values[new_poly_vertex_count] = vt_u; \
-						new_poly->v_values[new_poly_vertex_count] = vt_v; \
-						new_poly_vertex_count++; \
-
-				if (insidePlane(v1, plane)) {
-					if (insidePlane(v2, plane)) {
+				double d1 = previous_distance;
+				double d2 = v2.dotProduct(plane);
+
+				// adds the point where v1 -> v2 crosses the plane
+				// the edge can't be parallel to the plane, since d1 and d2 are on
+				// opposite sides of it
+				auto addIntersection = [&]() {
+					double t = d1 / (d1 - d2);
+
+					new_poly->vertices[new_poly_vertex_count] =
+							v1.add(v2.subtract(v1).scalarMultiply(t));
+					new_poly->shades[new_poly_vertex_count] =
+							original_poly->shades[previous]
+							+ (original_poly->shades[current] - original_poly->shades[previous]) * t;
+					new_poly->u_values[new_poly_vertex_count] =
+							original_poly->u_values[previous]
+							+ (original_poly->u_values[current] - original_poly->u_values[previous]) * t;
+					new_poly->v_values[new_poly_vertex_count] =
+							original_poly->v_values[previous]
+							+ (original_poly->v_values[current] - original_poly->v_values[previous]) * t;
+					new_poly_vertex_count++;
+				};
+
+				auto addCurrentVertex = [&]() {
+					new_poly->vertices[new_poly_vertex_count] = v2;
+					new_poly->shades[new_poly_vertex_count] = original_poly->shades[current];
+					new_poly->u_values[new_poly_vertex_count] = original_poly->u_values[current];
+					new_poly->v_values[new_poly_vertex_count] = original_poly->v_values[current];
+					new_poly_vertex_count++;
+				};
+
+				if (d1 > 0) {
+					if (d2 > 0) {
 						// just add current
-						addCurrentVertex(v2, vt_u2, vt_v2);
+						addCurrentVertex();
 					} else {
-						// add the intersect
-						double nDotV = plane.dotProduct(v1.subtract(v2));
-
-						// nDotV is 0 if v1->v2 is parallel to the plane.  This shouldn't be
-						// possible if one is in and one is out, but who knows.  As a fallback,
-						// we'll just add the current vertex since it's basically inside anyways
-						// ... right?
-						if (nDotV != 0) {
-							double t = plane.dotProduct(v1) / nDotV;
-							new_poly->vertices[new_poly_vertex_count] =
-									v1.add(v2.subtract(v1).scalarMultiply(t));
-							new_poly->shades[new_poly_vertex_count] = s1 + (s2 - s1) * t;
-							new_poly->u_values[new_poly_vertex_count] =
-									(vt_u1 + (vt_u2 - vt_u1) * t);
-							new_poly->v_values[new_poly_vertex_count] =
-									(vt_v1 + (vt_v2 - vt_v1) * t);
-							new_poly_vertex_count++;
-						} else {
-							addCurrentVertex(v2, vt_u2, vt_v2);
-						}
+						addIntersection();
 					}
+				} else if (d2 > 0) {
+					addIntersection();
+					addCurrentVertex();
 				} else {
-					if (insidePlane(v2, plane)) {
-						// add the intersect
-						double nDotV = plane.dotProduct(v1.subtract(v2));
-
-						if (nDotV != 0) {
-							double t = plane.dotProduct(v1) / nDotV;
-							new_poly->vertices[new_poly_vertex_count] =
-									v1.add(v2.subtract(v1).scalarMultiply(t));
-							new_poly->shades[new_poly_vertex_count] = s1 + (s2 - s1) * t;
-							new_poly->u_values[new_poly_vertex_count] =
-									(vt_u1 + (vt_u2 - vt_u1) * t);
-							new_poly->v_values[new_poly_vertex_count] =
-									(vt_v1 + (vt_v2 - vt_v1) * t);
-							new_poly_vertex_count++;
-						}
-
-						// then add current
-						addCurrentVertex(v2, vt_u2, vt_v2);
-					} else {
-						// both previous and current are outside the plane, do nothing
-					}
+					// both previous and current are outside the plane, do nothing
 				}
 
-				previous += 1;
-				current += 1;
-				if (previous == original_poly->vertex_count) {
-					previous = 0;
-				}
+				previous = current;
+				previous_distance = d2;
 			}
 
+			new_poly->vertex_count = new_poly_vertex_count;
+
 			if (new_poly_vertex_count == 0) {
 				// clipped out of existence
-				return *new_poly;
+				return new_poly;
 			}
 
-			new_poly->vertex_count = new_poly_vertex_count;
-
-			if (i < NUM_FRUSTUM_PLANES - 1) {
-				// swap for the next plane
-				ClippedPolygon* temp = original_poly;
-				original_poly = new_poly;
-				new_poly = temp;
-
-				new_poly->vertex_count = 0;
-			}
+			// swap for the next plane
+			std::swap(original_poly, new_poly);
 		}
 
-		return *new_poly;
+		return original_poly;
 	}
 
 	bool isBackFace(Vector triangle_normal, Vector vertex) {
@@ -225,7 +397,7 @@ struct Renderer {
 		return vertex_to_camera.dotProduct(triangle_normal) <= 0;
 	}
 
-	double applyLighting(Vector& normal, std::vector<Light>& lights) {
+	double applyLighting(Vector normal, std::vector<Light>& lights) {
 		double result = 0;
 
 		for (auto& light : lights) {
@@ -245,8 +417,8 @@ struct Renderer {
 
 	// draw the axes as a helpful diagram in front of the player
 	void drawPointers(Camera& camera) {
-		Vector cameraDirection = Matrix::makeRotationMatrix(camera.rotation).
-				multiplyVector(Vector::direction(0, 0, -1)).unit();
+		Vector cameraDirection = AffineTransform::rotation(camera.rotation).
+				transformDirection(Vector::direction(0, 0, -1)).unit();
 
 		Vector offset = cameraDirection.scalarMultiply(2);
 		Vector position = camera.position.add(offset);
@@ -261,16 +433,16 @@ struct Renderer {
 		Vector z1 = position.add(Vector::direction(0.05, 0, 0.45));
 		Vector z2 = position.add(Vector::direction(-0.05, 0, 0.45));
 
-		position = this->camera_matrix.multiplyVector(position);
-		x = this->camera_matrix.multiplyVector(x);
-		x1 = this->camera_matrix.multiplyVector(x1);
-		x2 = this->camera_matrix.multiplyVector(x2);
-		y = this->camera_matrix.multiplyVector(y);
-		y1 = this->camera_matrix.multiplyVector(y1);
-		y2 = this->camera_matrix.multiplyVector(y2);
-		z = this->camera_matrix.multiplyVector(z);
-		z1 = this->camera_matrix.multiplyVector(z1);
-		z2 = this->camera_matrix.multiplyVector(z2);
+		position = this->camera_matrix.transformPoint(position);
+		x = this->camera_matrix.transformPoint(x);
+		x1 = this->camera_matrix.transformPoint(x1);
+		x2 = this->camera_matrix.transformPoint(x2);
+		y = this->camera_matrix.transformPoint(y);
+		y1 = this->camera_matrix.transformPoint(y1);
+		y2 = this->camera_matrix.transformPoint(y2);
+		z = this->camera_matrix.transformPoint(z);
+		z1 = this->camera_matrix.transformPoint(z1);
+		z2 = this->camera_matrix.transformPoint(z2);
 
 		Point po = projectVertexToScreen(position, camera.viewport);
 
@@ -301,246 +473,446 @@ struct Renderer {
 		drawLine(pz1, pz2, device::getColorValue(0.0, 0.0, 1.0));
 	}
 
+	void drawTriangle(Triangle2D& triangle) {
+		if (this->drawing_static) {
+			this->span_buffer.addTriangle(triangle);
+			return;
+		}
+
+		switch (this->fill_method) {
+			case FillMethod::scanline:
+				triangle.fillShaded();
+				break;
+			case FillMethod::barycentric:
+#if USE_TILED_RASTERIZER
+				this->tile_rasterizer->addTriangle(triangle);
+#else
+				triangle.fillBarycentric();
+#endif
+				break;
+			case FillMethod::edge_function:
+#if USE_TILED_RASTERIZER
+				this->tile_rasterizer->addTriangle(triangle);
+#else
+				triangle.fillEdgeFunction();
+#endif
+				break;
+		}
+	}
+
+	// item must already be in world space (see Entity::model_in_world), it's
+	// read in place and moved into camera space with camera_vertices
+	// static models' lighting is kept between frames, see lightModel()
 	void drawModel(
-			Model item,
+			const Model& item,
 			Viewport& viewport,
 			std::vector<Light>& lights,
-			int translucency) {
-		// bool is_vertex_visible[item.vertices.size()];
-		// Point projected_vertices[item.vertices.size()];
-		bool is_vertex_visible[TEMP_ARRAY_SIZE];
-		Point projected_vertices[TEMP_ARRAY_SIZE];
+			int translucency,
+			bool is_static = false) {
+		if (this->cull_models && this->isOutsideFrustum(item)) {
+			this->stats.models_culled++;
+			return;
+		}
 
-		for (int i = 0; i < item.vertices.size(); i++) {
-			is_vertex_visible[i] = insideFrustum(item.vertices[i]);
+		this->stats.models_drawn++;
+		this->projectModel(item, viewport);
+		this->lightModel(item, lights, is_static);
 
-			if (is_vertex_visible[i]) {
-				projected_vertices[i] = projectVertexToScreen(item.vertices[i], viewport);
-			}
+		Texture* texture = item.has_texture ? item.texture : nullptr;
+
+		for (size_t i = 0; i < item.triangles.size(); i++) {
+			drawModelTriangle(item, i, texture, viewport, lights, translucency);
 		}
+	}
 
-		for (auto& triangle : item.triangles) {
-			Vector triangleNormal = triangle.getNormal();
+	// draws the faces of the world that could be visible from the camera,
+	// nearest first, see BSPWorld::findVisibleFaces()
+	// all of its vertices are projected, since they're shared between faces
+	// faces are lit by their lightmaps, see BSPWorld::faceSurface()
+	void drawWorld(BSPWorld& world, Camera& camera, std::vector<Light>& lights) {
+		const std::vector<int>& visible_faces = world.findVisibleFaces(camera.position);
 
-			if (isBackFace(triangleNormal, item.vertices[triangle.v0.index])) {
-				// this is a back face, don't draw
-				continue;
-			}
+		this->projectModel(world.model, camera.viewport);
+		this->lightModel(world.model, lights, true);
 
-			if (item.compute_lighting) {
-				if (item.normals.size() > 0) {
-					triangle.v0.light_intensity = applyLighting(
-							item.normals[triangle.v0.normal], lights);
-					triangle.v1.light_intensity = applyLighting(
-							item.normals[triangle.v1.normal], lights);
-					triangle.v2.light_intensity = applyLighting(
-							item.normals[triangle.v2.normal], lights);
-				} else {
-					triangle.v0.light_intensity = applyLighting(triangleNormal, lights);
-					triangle.v1.light_intensity = applyLighting(triangleNormal, lights);
-					triangle.v2.light_intensity = applyLighting(triangleNormal, lights);
-				}
+		for (int face_index : visible_faces) {
+			BSPWorld::Face& face = world.faces[face_index];
+			Texture* texture = world.faceSurface(face_index);
+
+			for (int i = 0; i < face.triangle_count; i++) {
+				drawModelTriangle(
+						world.model,
+						face.first_triangle + i,
+						texture,
+						camera.viewport,
+						lights,
+						0);
 			}
+		}
 
-			Texture* texture = nullptr;
+		this->stats.world_faces_drawn = visible_faces.size();
+	}
 
-			if (item.has_texture && !triangle.ignore_texture) {
-				texture = item.texture;
-			}
+	// moves a model's vertices into camera space, and finds their outcodes and
+	// (if they don't need clipping) where they are on screen
+	void projectModel(const Model& item, Viewport& viewport) {
+		this->transformToCamera(item);
 
-			if (is_vertex_visible[triangle.v0.index] &&
-					is_vertex_visible[triangle.v1.index] &&
-					is_vertex_visible[triangle.v2.index]) {
-				// all vertices are visible
-				Triangle2D tri = {
-						projected_vertices[triangle.v0.index],
-						projected_vertices[triangle.v1.index],
-						projected_vertices[triangle.v2.index],
-						triangle.color,
-						triangle.v0.light_intensity,
-						triangle.v1.light_intensity,
-						triangle.v2.light_intensity,
-						1 / item.vertices[triangle.v0.index].z,
-						1 / item.vertices[triangle.v1.index].z,
-						1 / item.vertices[triangle.v2.index].z,
-						item.uvs[triangle.v0.uv].first,
-						item.uvs[triangle.v0.uv].second,
-						item.uvs[triangle.v1.uv].first,
-						item.uvs[triangle.v1.uv].second,
-						item.uvs[triangle.v2.uv].first,
-						item.uvs[triangle.v2.uv].second,
-						texture,
-						translucency};
+		VertexStream& vertices = this->camera_vertices;
 
-				// tri.draw();
-#if USE_BARYCENTRIC
-				tri.fillBarycentric();
-#else
-				tri.fillShaded();
-#endif
-			} else {
-				// not all vertices are visible
-				// it's clipping time
-				ClippedPolygon triangle_poly = ClippedPolygon{
-						{
-							item.vertices[triangle.v0.index],
-							item.vertices[triangle.v1.index],
-							item.vertices[triangle.v2.index]
-						},
-						{
-							triangle.v0.light_intensity,
-							triangle.v1.light_intensity,
-							triangle.v2.light_intensity,
-						},
-						{
-							item.uvs[triangle.v0.uv].first,
-							item.uvs[triangle.v1.uv].first,
-							item.uvs[triangle.v2.uv].first,
-						},
-						{
-							item.uvs[triangle.v0.uv].second,
-							item.uvs[triangle.v1.uv].second,
-							item.uvs[triangle.v2.uv].second,
-						},
-						3};
-
-				ClippedPolygon poly = clipTriangle(triangle_poly);
-
-				if (poly.vertex_count == 0) {
-					// clipped out of existence, move on
-					continue;
-				}
+		uint16_t* outcodes = this->vertex_outcodes.fit(vertices.size());
+		Point* projected_vertices = this->vertex_projections.fit(vertices.size());
 
-				// Point projected_vertices[poly.vertex_count];
-				Point projected_vertices[TEMP_ARRAY_SIZE];
+		for (size_t i = 0; i < vertices.size(); i++) {
+			Vector vertex = vertices.point(i);
+			outcodes[i] = frustumOutcode(vertex);
 
-				for (int i = 0; i < poly.vertex_count; i++) {
-					projected_vertices[i] = projectVertexToScreen(poly.vertices[i], viewport);
-				}
+			if (clipPlanes(outcodes[i]) == 0) {
+				projected_vertices[i] = projectVertexToSubpixels(vertex, viewport);
+			}
+		}
+	}
 
-				// triangulate the resulting polygon, with all triangles starting at v0
-				for (int i = 1; i < poly.vertex_count - 1; i++) {
-					Triangle2D new_triangle = {
-							projected_vertices[0],
-							projected_vertices[i],
-							projected_vertices[i + 1],
-							triangle.color,
-							poly.shades[0],
-							poly.shades[i],
-							poly.shades[i + 1],
-							1 / poly.vertices[0].z,
-							1 / poly.vertices[i].z,
-							1 / poly.vertices[i + 1].z,
-							poly.u_values[0],
-							poly.v_values[0],
-							poly.u_values[i],
-							poly.v_values[i],
-							poly.u_values[i + 1],
-							poly.v_values[i + 1],
-							texture,
-							translucency};
-
-					// new_triangle.draw();
-					#if USE_BARYCENTRIC
-									new_triangle.fillBarycentric();
-					#else
-									new_triangle.fillShaded();
-					#endif
-				}
+	// Lighting only depends on the normal, since there are only ambient and
+	// directional lights, so each normal is lit once here instead of at every
+	// corner that shares it.  Everything is lit in world space, so static
+	// models' lighting doesn't change until the lights do, and they keep it in
+	// Model::cached_lighting.
+	// Moving models without normals are lit a triangle at a time as they're
+	// drawn instead, so back faces aren't lit for nothing.
+	void lightModel(const Model& item, std::vector<Light>& lights, bool is_static) {
+		bool per_normal = item.normals.size() > 0;
+		size_t count = per_normal ? item.normals.size() : item.triangles.size();
+
+		if (!item.compute_lighting || (!per_normal && !is_static)) {
+			this->model_lighting = nullptr;
+			return;
+		}
+
+		double* lighting;
+
+		if (is_static && this->cache_static_lighting) {
+			if (item.cached_lighting_generation == this->lighting_generation
+					&& item.cached_lighting.size() == count) {
+				this->model_lighting = item.cached_lighting.data();
+				return;
 			}
+
+			item.cached_lighting.resize(count);
+			item.cached_lighting_generation = this->lighting_generation;
+			lighting = item.cached_lighting.data();
+		} else {
+			lighting = this->normal_lighting.fit(count);
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			lighting[i] = applyLighting(
+					per_normal ? item.normals[i] : item.triangles[i].normal, lights);
 		}
+
+		this->model_lighting = lighting;
 	}
 
-	Model buildCameraModel(Entity& item) {
-		Model result = *item.model;
+	// item must be the last model passed to projectModel() and lightModel()
+	// texture is ignored if the triangle is meant to be a solid color
+	void drawModelTriangle(
+			const Model& item,
+			size_t triangle_index,
+			Texture* texture,
+			Viewport& viewport,
+			std::vector<Light>& lights,
+			int translucency) {
+		const Triangle3D& triangle = item.triangles[triangle_index];
+		uint16_t* outcodes = this->vertex_outcodes.data();
+		Point* projected_vertices = this->vertex_projections.data();
 
-		Matrix worldMatrix = Matrix::makeWorldMatrix(
-				item.scale, item.actualRotation(), item.position);
-		Matrix finalMatrix = this->camera_matrix.multiplyMatrix(worldMatrix);
+		int outcode0 = outcodes[triangle.v0.index];
+		int outcode1 = outcodes[triangle.v1.index];
+		int outcode2 = outcodes[triangle.v2.index];
 
-		// transform vertices into camera space
-		for (auto& vertex : result.vertices) {
-			vertex = finalMatrix.multiplyVector(vertex);
+		if (outcode0 & outcode1 & outcode2) {
+			// entirely outside one of the planes
+			return;
 		}
 
-		// transform normals
-		Matrix normalTransformationMatrix =
-				this->camera_matrix.multiplyMatrix(Matrix::makeRotationMatrix(item.rotation));
+		Vector vertex0 = this->camera_vertices.point(triangle.v0.index);
+		Vector vertex1 = this->camera_vertices.point(triangle.v1.index);
+		Vector vertex2 = this->camera_vertices.point(triangle.v2.index);
+		Vector triangleNormal = this->camera_matrix.transformDirection(triangle.normal);
 
-		for (auto& normal : result.normals) {
-			normal = normalTransformationMatrix.multiplyVector(normal);
+		if (isBackFace(triangleNormal, vertex0)) {
+			// this is a back face, don't draw
+			return;
 		}
 
-		for (auto& triangle : result.triangles) {
-			triangle.normal = normalTransformationMatrix.multiplyVector(triangle.normal);
+		// the model is shared with physics, so lighting isn't written back to it
+		double light0 = triangle.v0.light_intensity;
+		double light1 = triangle.v1.light_intensity;
+		double light2 = triangle.v2.light_intensity;
+
+		if (!item.compute_lighting) {
+			// keep the vertices' own lighting
+		} else if (this->model_lighting == nullptr) {
+			light0 = applyLighting(triangle.normal, lights);
+			light1 = light0;
+			light2 = light0;
+		} else if (item.normals.size() > 0) {
+			light0 = this->model_lighting[triangle.v0.normal];
+			light1 = this->model_lighting[triangle.v1.normal];
+			light2 = this->model_lighting[triangle.v2.normal];
+		} else {
+			light0 = this->model_lighting[triangle_index];
+			light1 = light0;
+			light2 = light0;
 		}
 
-		return result;
-	}
+		if (triangle.ignore_texture) {
+			texture = nullptr;
+		}
+
+		int planes = clipPlanes(outcode0 | outcode1 | outcode2);
+
+		if (planes == 0) {
+			// all vertices are visible, or close enough for the rasterizer to cut
+			// the triangle down to the screen
+			Point s0 = projected_vertices[triangle.v0.index];
+			Point s1 = projected_vertices[triangle.v1.index];
+			Point s2 = projected_vertices[triangle.v2.index];
+
+			Triangle2D tri = {
+					pixelFromSubpixel(s0),
+					pixelFromSubpixel(s1),
+					pixelFromSubpixel(s2),
+					triangle.color,
+					light0,
+					light1,
+					light2,
+					1 / vertex0.z,
+					1 / vertex1.z,
+					1 / vertex2.z,
+					item.uvs[triangle.v0.uv].first,
+					item.uvs[triangle.v0.uv].second,
+					item.uvs[triangle.v1.uv].first,
+					item.uvs[triangle.v1.uv].second,
+					item.uvs[triangle.v2.uv].first,
+					item.uvs[triangle.v2.uv].second,
+					texture,
+					translucency,
+					this->perspective_span,
+					s0,
+					s1,
+					s2};
+
+			// tri.draw();
+			drawTriangle(tri);
+		} else {
+			// not all vertices can be drawn
+			// it's clipping time
+			ClippedPolygon triangle_poly = ClippedPolygon{
+					{vertex0, vertex1, vertex2},
+					{
+						light0,
+						light1,
+						light2,
+					},
+					{
+						item.uvs[triangle.v0.uv].first,
+						item.uvs[triangle.v1.uv].first,
+						item.uvs[triangle.v2.uv].first,
+					},
+					{
+						item.uvs[triangle.v0.uv].second,
+						item.uvs[triangle.v1.uv].second,
+						item.uvs[triangle.v2.uv].second,
+					},
+					3};
+
+			ClippedPolygon scratch_poly;
+			ClippedPolygon& poly = *clipTriangle(&triangle_poly, &scratch_poly, planes);
+
+			if (poly.vertex_count == 0) {
+				// clipped out of existence, move on
+				return;
+			}
+
+			std::array<Point, MAX_CLIPPED_POLYGON_VERTICES> clipped_vertices;
 
-	Model buildCameraModelFromWorldModel(Model model) {
-		// levels are already in world space, so just do a camera transformations
+			for (size_t i = 0; i < poly.vertex_count; i++) {
+				clipped_vertices[i] = projectVertexToSubpixels(poly.vertices[i], viewport);
+			}
 
-		// transform vertices into camera space
-		for (auto& vertex : model.vertices) {
-			vertex = this->camera_matrix.multiplyVector(vertex);
+			// triangulate the resulting polygon, with all triangles starting at v0
+			for (size_t i = 1; i + 1 < poly.vertex_count; i++) {
+				Triangle2D new_triangle = {
+						pixelFromSubpixel(clipped_vertices[0]),
+						pixelFromSubpixel(clipped_vertices[i]),
+						pixelFromSubpixel(clipped_vertices[i + 1]),
+						triangle.color,
+						poly.shades[0],
+						poly.shades[i],
+						poly.shades[i + 1],
+						1 / poly.vertices[0].z,
+						1 / poly.vertices[i].z,
+						1 / poly.vertices[i + 1].z,
+						poly.u_values[0],
+						poly.v_values[0],
+						poly.u_values[i],
+						poly.v_values[i],
+						poly.u_values[i + 1],
+						poly.v_values[i + 1],
+						texture,
+						translucency,
+						this->perspective_span,
+						clipped_vertices[0],
+						clipped_vertices[i],
+						clipped_vertices[i + 1]};
+
+				// new_triangle.draw();
+				drawTriangle(new_triangle);
+			}
 		}
+	}
 
-		for (auto& normal : model.normals) {
-			normal = this->camera_matrix.multiplyVector(normal);
+	// models are already in world space, so this is just the camera transform,
+	// done on all of the vertices at once, see transformPoints()
+	// triangle normals are transformed as they're drawn, since back faces only
+	// need the one, and lighting is done in world space, see lightModel()
+	void transformToCamera(const Model& model) {
+		transformPoints(this->camera_matrix, model.positionStream(), this->camera_vertices);
+	}
+
+	static bool sameLights(const std::vector<Light>& a, const std::vector<Light>& b) {
+		if (a.size() != b.size()) {
+			return false;
 		}
 
-		for (auto& triangle : model.triangles) {
-			triangle.normal = this->camera_matrix.multiplyVector(triangle.normal);
+		for (size_t i = 0; i < a.size(); i++) {
+			if (a[i].type != b[i].type
+					|| a[i].intensity != b[i].intensity
+					|| a[i].direction.x != b[i].direction.x
+					|| a[i].direction.y != b[i].direction.y
+					|| a[i].direction.z != b[i].direction.z) {
+				return false;
+			}
 		}
 
-		return model;
+		return true;
+	}
+
+	// models are drawn in a pass for opaque and one for translucent ones, see
+	// sort_models, and static opaque ones can go through the span buffer, see
+	// use_span_buffer
+	void queueModel(const Model& model, int translucency, bool is_static = false) {
+		double depth = this->camera_matrix.transformPoint(model.bounding_center).z;
+		QueuedModel queued = {&model, translucency, is_static, depth};
+
+		// translucency only skips pixels when it's more than 1, see
+		// Triangle2D::translucency
+		if (translucency <= 1 && is_static && this->use_span_buffer) {
+			this->static_models.push_back(queued);
+		} else if (translucency <= 1) {
+			this->opaque_models.push_back(queued);
+		} else {
+			this->translucent_models.push_back(queued);
+		}
 	}
 
 	void drawScene(Scene& scene) {
 		// update camera matrix (should we check if it has changed first?)
-		this->camera_matrix = Matrix::makeCameraMatrix(
+		this->camera_matrix = AffineTransform::camera(
 				scene.camera.rotation, scene.camera.position);
 
+		// the render scale may have changed since the last frame
+		this->setUpFrustumPlanes(scene.camera.viewport);
+
+		this->stats = RenderStats();
+		resetShadedPixelCount();
+		resetOccludedTriangleCount();
+
 		// draw the background
 		// TODO: make this more interesting/dynamic
 		device::clearScreen(device::getColorValue(1.0, 1.0, 1.0));
 
-		// move the lights into camera space
-		std::vector<Light> lights = scene.lights;
+		// lighting is done in world space, so static models' cached lighting only
+		// has to be redone when the lights change
+		std::vector<Light>& lights = scene.lights;
 
-		for (auto& light : lights) {
-			if (light.type == Light::Type::directional) {
-				light.direction = this->camera_matrix.multiplyVector(light.direction);
-			}
+		if (!sameLights(lights, this->cached_lights)) {
+			this->cached_lights = lights;
+			this->lighting_generation++;
 		}
 
-		// draw player
-		drawModel(
-				buildCameraModelFromWorldModel(scene.player.model_in_world),
-						scene.camera.viewport,
-						lights,
-						scene.player.translucency);
+		this->opaque_models.clear();
+		this->translucent_models.clear();
+		this->static_models.clear();
 
-		// draw player's weapon
-		drawModel(
-				buildCameraModelFromWorldModel(scene.player.weapon.model_in_world),
-						scene.camera.viewport,
-						lights,
-						scene.player.weapon.translucency);
+		queueModel(scene.player.model_in_world, scene.player.translucency);
+		queueModel(scene.player.weapon.model_in_world, scene.player.weapon.translucency);
 
-		// draw entities
 		for (auto& entity : scene.entities) {
 			if (entity.active) {
-				drawModel(
-						buildCameraModelFromWorldModel(entity.model_in_world),
-								scene.camera.viewport,
-								lights,
-								entity.translucency);
+				queueModel(entity.model_in_world, entity.translucency, entity.is_static);
+			}
+		}
+
+		// the span buffer works out what's in front by itself, and the z buffer
+		// it leaves behind is what everything else is tested against
+		if (this->use_span_buffer) {
+			this->drawing_static = true;
+
+			if (scene.world) {
+				drawWorld(*scene.world, scene.camera, lights);
+			}
+
+			for (auto& queued : this->static_models) {
+				drawModel(*queued.model, scene.camera.viewport, lights, queued.translucency, queued.is_static);
 			}
+
+			this->drawing_static = false;
+			this->span_buffer.flush();
+			this->stats.static_spans_drawn = this->span_buffer.spanCount();
+		} else if (scene.world) {
+			drawWorld(*scene.world, scene.camera, lights);
 		}
 
+		if (this->sort_models) {
+			// z is negative in front of the camera, so nearer is larger
+			std::sort(
+					this->opaque_models.begin(),
+					this->opaque_models.end(),
+					[](const QueuedModel& a, const QueuedModel& b) { return a.depth > b.depth; });
+			std::sort(
+					this->translucent_models.begin(),
+					this->translucent_models.end(),
+					[](const QueuedModel& a, const QueuedModel& b) { return a.depth < b.depth; });
+		}
+
+		for (auto& queued : this->opaque_models) {
+			drawModel(*queued.model, scene.camera.viewport, lights, queued.translucency, queued.is_static);
+		}
+
+		for (auto& queued : this->translucent_models) {
+			drawModel(*queued.model, scene.camera.viewport, lights, queued.translucency, queued.is_static);
+		}
+
+		// everything has to be on screen before drawing over it
+		this->tile_rasterizer->flush(this->fill_method);
+
+		this->stats.overdraw = COUNT_OVERDRAW
+				? (double)shadedPixelCount() / (device::getXRes() * device::getYRes())
+				: -1;
+		this->stats.triangles_occluded = occludedTriangleCount();
+
 		drawPointers(scene.camera);
+
+#if LOG_RENDER_STATS
+		device::logOncePerSecond(
+				"models drawn: %d, culled: %d, world faces drawn: %d, overdraw: %.2f\n",
+				this->stats.models_drawn,
+				this->stats.models_culled,
+				this->stats.world_faces_drawn,
+				this->stats.overdraw);
+#endif
 	}
 };
 
@@ -8,7 +8,10 @@
 #include "../vector.h"
 
 #include "bmp.h"
+#include "bsp_world.h"
 #include "entity.h"
+#include "level.h"
+#include "lightmap.h"
 #include "model.h"
 #include "obj.h"
 #include "ppm.h"
@@ -32,134 +35,31 @@ const char* basic_level_file = "assets/basic.level";
 #endif
 
 
+// set this to 1 to lower the render scale when frames take longer than
+// TARGET_FRAME_DURATION, and raise it again when there's headroom
+#define DYNAMIC_RESOLUTION 0
+#define TARGET_FRAME_DURATION std::chrono::microseconds(16667)
+#define RENDER_SCALE_STEP 0.05
+#define MIN_DYNAMIC_RENDER_SCALE 0.5
 
-#include <fstream>
-#include <iostream>
-#include <sstream>
-#include <string>
+void updateDynamicResolution(std::chrono::microseconds frame_duration) {
+	double scale = device::getRenderScale();
 
-// struct Fighter {
-// 	Vector pos = Vector::origin();
-// 	Vector rot = Vector::direction(0.0, 0.0, 0.0);
-// };
-
-struct Platform {
-	Vector start_pos = Vector::origin();
-	Vector end_pos = Vector::origin();
-	Model model;
-};
-
-struct LevelData {
-	std::vector<Entity> fighters;
-	std::vector<Platform> platforms;
-	bool valid = false;
-
-	float fighter_height;
-	float fighter_width;
-	float fighter_eye_height;
-	Model fighter_model; // fighters share the same model for now
-};
-
-void logLevelLoadError(const char* message, std::string line) {
-	printf("%s: %s\n", message, line.c_str());
-}
-
-Model buildFighterModel(float height, float width, float eye_height) {
-		// the model will have its bottom centered at the origin
-		Vector start = Vector::point(-width, 0, -width);
-		Vector end = Vector::point(width, height, width);
-
-		return Model::buildHexahedron(start, end);
+	if (frame_duration > TARGET_FRAME_DURATION * 11 / 10) {
+		scale -= RENDER_SCALE_STEP;
+	} else if (frame_duration < TARGET_FRAME_DURATION * 8 / 10) {
+		scale += RENDER_SCALE_STEP;
 	}
 
-LevelData loadLevelFromFile(const char* filename) {
-	std::ifstream level_file(filename);
-	LevelData level_data;
-
-	bool got_fighter_dimensions = false;
-
-	if (!level_file.is_open()) {
-		printf("couldn't read level file %s!\n", filename);
-		return level_data;
-	}
-
-	std::string line;
-
-	while (std::getline(level_file, line)) {
-		if (line.size() == 0 || line[0] == '#') {
-			continue;
-		}
-
-		std::istringstream line_stream(line);
-		char first_char;
-		line_stream >> first_char;
-
-		if (first_char == 'i') {
-			// shared fighter info
-			if (!(line_stream >> level_data.fighter_height >> level_data.fighter_width >> level_data.fighter_eye_height)) {
-				logLevelLoadError("fighter shared info improperly formatted!", line);
-				return level_data;
-			}
-
-			got_fighter_dimensions = true;
-		} else if (first_char == 'f') {
-			// load a fighter
-			if (!got_fighter_dimensions) {
-				logLevelLoadError("need shared fighter info before loading fighters!", line);
-				return level_data;
-			}
-
-			Entity fighter;
-
-			if (!(line_stream >> fighter.position.x >> fighter.position.y >> fighter.position.z)) {
-				logLevelLoadError("fighter position improperly formatted!", line);
-				return level_data;
-			}
-
-			if (!(line_stream >> fighter.rotation.x >> fighter.rotation.y >> fighter.rotation.z)) {
-				logLevelLoadError("fighter rotation improperly formatted!", line);
-				return level_data;
-			}
-
-			level_data.fighters.push_back(fighter);
-		} else if (first_char == 'p') {
-			Platform platform;
-
-			if (!(line_stream >> platform.start_pos.x >> platform.start_pos.y >> platform.start_pos.z)) {
-				logLevelLoadError("platform start position improperly formatted!", line);
-				return level_data;
-			}
-
-			if (!(line_stream >> platform.end_pos.x >> platform.end_pos.y >> platform.end_pos.z)) {
-				logLevelLoadError("platform end position improperly formatted!", line);
-				return level_data;
-			}
-
-			platform.model = Model::buildHexahedron(platform.start_pos, platform.end_pos);
-
-			level_data.platforms.push_back(platform);
-		} else {
-			logLevelLoadError("unrecognized line", line);
-		}
+	if (scale < MIN_DYNAMIC_RENDER_SCALE) {
+		scale = MIN_DYNAMIC_RENDER_SCALE;
 	}
 
-	if (level_data.fighters.size() < 1) {
-		printf("no fighters found in level %s!\n", filename);
-	} else if (level_data.platforms.size() < 1) {
-		printf("no platforms found in level %s!\n", filename);
-	} else {
-		level_data.fighter_model = buildFighterModel(
-				level_data.fighter_height,
-				level_data.fighter_width,
-				level_data.fighter_eye_height);
-		level_data.valid = true;
+	if (scale != device::getRenderScale()) {
+		device::setRenderScale(scale);
 	}
-
-	return level_data;
 }
 
-
-
 int main(int argc, char** argv) {
 	if (!device::setUp()) {
 		return 1;
@@ -174,6 +74,23 @@ int main(int argc, char** argv) {
 		return 0;
 	}
 
+	// optionally, a Quake map to look around, e.g.
+	//   ./rockshot maps/e1m1.bsp gfx/palette.lmp
+	// there's no collision with it yet, so it's moved to put its player start
+	// where the player starts on the basic level's platforms
+	BSPWorld world;
+
+	if (argc > 2) {
+		world = loadBSPWorld(argv[1], argv[2]);
+
+		if (!world.valid) {
+			printf("couldn't load map\n");
+			return 0;
+		}
+
+		world.translate(basic_level.fighters[0].position.subtract(world.start_position));
+	}
+
 	// for now, player is the first fighter in the level
 	// later, others will be enemies
 	Player player;
@@ -207,6 +124,10 @@ int main(int argc, char** argv) {
 	Scene scene;
 	scene.init(std::move(player));
 
+	if (world.valid) {
+		scene.world = &world;
+	}
+
 	spit("Scene initialized successfully");
 
 	// add spinning cube
@@ -240,12 +161,23 @@ int main(int argc, char** argv) {
 	spit("Spinning crate created successfully");
 
 	// load Rocket Fighters entities (just platforms for now)
+	// they don't move, so their lighting (and the shadows they cast on each
+	// other) is baked into lightmaps
 	std::list<Model> platform_models;
+	std::list<Texture> platform_lightmaps;
+	std::vector<AABB> platform_boxes;
 
-	for (int i = 0; i < basic_level.platforms.size(); i++) {
+	for (auto& platform : basic_level.platforms) {
+		platform_boxes.push_back(AABB{platform.start_pos, platform.end_pos});
+	}
+
+	for (size_t i = 0; i < basic_level.platforms.size(); i++) {
 		Platform& platform = basic_level.platforms[i];
 		Model platform_model = Model::buildHexahedron(platform.start_pos, platform.end_pos);
 		platform_models.push_back(platform_model);
+		platform_lightmaps.emplace_back();
+		bakeBoxLightmap(
+				platform_models.back(), platform_lightmaps.back(), platform_boxes, scene.lights);
 
 		Entity platform_entity;
 		platform_entity.model = &(platform_models.back());
@@ -283,6 +215,10 @@ int main(int argc, char** argv) {
 				std::chrono::duration_cast<std::chrono::microseconds>(now - last_frame_time);
 		last_frame_time = now;
 
+#if DYNAMIC_RESOLUTION
+		updateDynamicResolution(frame_duration);
+#endif
+
 		scene.step(frame_duration);
 	}
 
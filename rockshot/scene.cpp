@@ -13,12 +13,11 @@ void Scene::init(Player player) {
 	this->camera.position.y += this->player.eye_height;
 	this->camera.rotation = this->player.rotation;
 
+	// the frustum planes are derived from the viewport in
+	// Renderer::setUpFrustumPlanes(), so any aspect ratio works
 	this->camera.viewport.width = 4;
-	this->camera.viewport.height = 3;
-	// I'd like to free up the aspect ratio, but trying to do so causes wonky
-	// behavior.  I think that's because of how I set up the frustum planes in
-	// Renderer::create().
-	// this->camera.viewport.height = 4 * device::getYRes() / device::getXRes();
+	this->camera.viewport.height =
+			this->camera.viewport.width * device::getYRes() / device::getXRes();
 	this->camera.viewport.distance = -2;
 	this->camera.viewport.near_plane_distance = -0.1;
 	this->camera.viewport.far_plane_distance = -100;
@@ -58,7 +57,12 @@ void flushEntityBuffer(std::vector<Entity>& entities) {
 void Scene::step(std::chrono::microseconds frame_duration) {
 	for (auto& entity : this->entities) {
 		if (entity.active) {
-			entity.buildWorldModel();
+			// static entities don't usually move, so their world models (and the
+			// lighting the renderer caches in them) are kept until an action or
+			// physics does move them
+			if (!entity.is_static || !entity.worldModelIsCurrent()) {
+				entity.buildWorldModel();
+			}
 
 			if (entity.has_action) {
 				entity.action(&entity, frame_duration);
@@ -11,6 +11,9 @@
 #include "player.h"
 
 
+struct BSPWorld;
+
+
 // define viewport
 struct Viewport {
 	double width;
@@ -56,6 +59,9 @@ struct Scene {
 	std::vector<Entity> entities;
 	std::vector<Light> lights;
 
+	// drawn before everything else when there is one, see Renderer::drawWorld()
+	BSPWorld* world = nullptr;
+
 	void init(Player player);
 
 	// Entity handling
@@ -0,0 +1,87 @@
+#ifndef BUFFDOG_SCRATCH_BUFFER
+#define BUFFDOG_SCRATCH_BUFFER
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "../util.h"
+
+
+// Working memory that's refilled for every model that's drawn, e.g. projected
+// vertices.  It only ever grows, so once it has been sized for the biggest
+// model it's reused without allocating, and unlike a fixed size array on the
+// stack, a big model can't overflow it.
+// Growing doesn't keep the old contents, so fill it after calling fit().
+template <typename T>
+struct ScratchBuffer {
+	static_assert(
+			std::is_trivially_copyable<T>::value,
+			"ScratchBuffer elements aren't constructed or copied when it grows");
+
+	ScratchBuffer() = default;
+
+	~ScratchBuffer() {
+		this->release();
+	}
+
+	ScratchBuffer(const ScratchBuffer&) = delete;
+	ScratchBuffer& operator=(const ScratchBuffer&) = delete;
+
+	ScratchBuffer(ScratchBuffer&& other) noexcept
+			: elements(other.elements), capacity(other.capacity) {
+		other.elements = nullptr;
+		other.capacity = 0;
+	}
+
+	ScratchBuffer& operator=(ScratchBuffer&& other) noexcept {
+		std::swap(this->elements, other.elements);
+		std::swap(this->capacity, other.capacity);
+
+		return *this;
+	}
+
+	// makes sure there's room for count elements
+	T* fit(size_t count) {
+		if (count > this->capacity) {
+			this->release();
+
+			// a whole number of cache lines, like util::alignedAlloc() rounds to
+			size_t bytes =
+					(count * sizeof(T) + util::kCacheLineSize - 1) & ~(util::kCacheLineSize - 1);
+
+			this->elements = static_cast<T*>(util::alignedAlloc(util::kCacheLineSize, bytes));
+
+			if (!this->elements) {
+				throw std::bad_alloc();
+			}
+
+			this->capacity = bytes / sizeof(T);
+		}
+
+		return this->elements;
+	}
+
+	T& operator[](size_t index) {
+		return this->elements[index];
+	}
+
+	T* data() {
+		return this->elements;
+	}
+
+private:
+	T* elements = nullptr;
+	size_t capacity = 0;
+
+	void release() {
+		if (this->elements) {
+			util::alignedFree(this->elements);
+			this->elements = nullptr;
+			this->capacity = 0;
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,272 @@
+#include <algorithm>
+#include <cmath>
+
+#include "../device.h"
+
+#include "span_buffer.h"
+
+
+// depths closer than this (relative to their size) are treated as the same,
+// see SpanBuffer::isNearer()
+constexpr double kSameDepthEpsilon = 1e-6;
+
+
+SpanBuffer::Gradient SpanBuffer::gradientFrom(
+		Point p0, Point p1, Point p2, double f0, double f1, double f2, double area) {
+	// per subpixel, like the positions
+	double step_x = ((f1 - f0) * (p2.y - p0.y) - (f2 - f0) * (p1.y - p0.y)) / area;
+	double step_y = ((f2 - f0) * (p1.x - p0.x) - (f1 - f0) * (p2.x - p0.x)) / area;
+
+	return Gradient{
+			f0 - p0.x * step_x - p0.y * step_y,
+			step_x * (1 << SUBPIXEL_BITS),
+			step_y * (1 << SUBPIXEL_BITS)};
+}
+
+// rounds a subpixel coordinate up to the first whole pixel at or after it
+static int ceilToPixel(int subpixel) {
+	return (subpixel + (1 << SUBPIXEL_BITS) - 1) >> SUBPIXEL_BITS;
+}
+
+void SpanBuffer::addTriangle(const Triangle2D& triangle) {
+	// the subpixel positions, so that the edges are where the edge function
+	// fill puts them, see SUBPIXEL_BITS
+	Point p0 = triangle.s0;
+	Point p1 = triangle.s1;
+	Point p2 = triangle.s2;
+
+	double area = (double)(p1.x - p0.x) * (p2.y - p0.y) - (double)(p2.x - p0.x) * (p1.y - p0.y);
+
+	if (area == 0) {
+		// degenerate, it doesn't cover any pixels
+		return;
+	}
+
+	// the resolution can change between frames
+	if (this->surfaces.empty()) {
+		this->scanline_edges.assign(device::getYRes(), -1);
+	}
+
+	Surface surface;
+	surface.triangle = triangle;
+	surface.mip_level = surface.triangle.mipLevel();
+	surface.inv_z = gradientFrom(
+			p0, p1, p2, triangle.invZ0, triangle.invZ1, triangle.invZ2, area);
+	surface.depth = Gradient{
+			-surface.inv_z.at_origin, -surface.inv_z.step_x, -surface.inv_z.step_y};
+	surface.shade = gradientFrom(
+			p0, p1, p2, triangle.h0, triangle.h1, triangle.h2, area);
+	surface.inv_u = gradientFrom(
+			p0,
+			p1,
+			p2,
+			triangle.u0 * triangle.invZ0,
+			triangle.u1 * triangle.invZ1,
+			triangle.u2 * triangle.invZ2,
+			area);
+	surface.inv_v = gradientFrom(
+			p0,
+			p1,
+			p2,
+			triangle.v0 * triangle.invZ0,
+			triangle.v1 * triangle.invZ1,
+			triangle.v2 * triangle.invZ2,
+			area);
+	surface.crossings = 0;
+
+	int index = this->surfaces.size();
+	this->surfaces.push_back(surface);
+
+	this->addEdge(p0, p1, p2, index);
+	this->addEdge(p1, p2, p0, index);
+	this->addEdge(p2, p0, p1, index);
+}
+
+void SpanBuffer::addEdge(Point start, Point end, Point opposite, int surface) {
+	if (start.y == end.y) {
+		// horizontal edges don't cross any scanlines
+		return;
+	}
+
+	// the opposite vertex is on the surface's side of the edge
+	long long cross =
+			(long long)(end.x - start.x) * (opposite.y - start.y)
+			- (long long)(end.y - start.y) * (opposite.x - start.x);
+	bool entering = (cross < 0) == (end.y > start.y);
+
+	Point low = start.y < end.y ? start : end;
+	Point high = start.y < end.y ? end : start;
+
+	// the edge covers the scanlines from the first one at or below its low end
+	// up to the first one at or below its high end, starting where it crosses
+	// that first one
+	double x_step = (double)(high.x - low.x) / (high.y - low.y);
+	int y = ceilToPixel(low.y);
+	int y_end = std::min(ceilToPixel(high.y), (int)this->scanline_edges.size());
+	double x = (low.x + x_step * (y * (1 << SUBPIXEL_BITS) - low.y)) / (1 << SUBPIXEL_BITS);
+
+	if (y < 0) {
+		x -= x_step * y;
+		y = 0;
+	}
+
+	if (y >= y_end) {
+		return;
+	}
+
+	this->edges.push_back(Edge{x, x_step, y_end, surface, entering, this->scanline_edges[y]});
+	this->scanline_edges[y] = this->edges.size() - 1;
+}
+
+void SpanBuffer::flush() {
+	this->span_count = 0;
+
+	if (this->surfaces.empty()) {
+		return;
+	}
+
+	this->active_edges.clear();
+
+	for (int y = 0; y < (int)this->scanline_edges.size(); y++) {
+		for (int edge = this->scanline_edges[y]; edge >= 0; edge = this->edges[edge].next) {
+			this->active_edges.push_back(edge);
+		}
+
+		if (!this->active_edges.empty()) {
+			this->drawScanline(y);
+		}
+	}
+
+	// the memory is kept for the next frame
+	this->surfaces.clear();
+	this->edges.clear();
+}
+
+void SpanBuffer::drawScanline(int y) {
+	std::vector<Edge>& edges = this->edges;
+	std::vector<int>& active = this->active_edges;
+
+	// edges only swap places where their triangles meet, so the list is nearly
+	// sorted from the last scanline already
+	// at the same x, leaving edges come first, so that a surface that ends
+	// where another one starts doesn't hide it
+	auto comesBefore = [&edges](int a, int b) {
+		return edges[a].x < edges[b].x
+				|| (edges[a].x == edges[b].x && !edges[a].entering && edges[b].entering);
+	};
+
+	for (size_t i = 1; i < active.size(); i++) {
+		int edge = active[i];
+		size_t j = i;
+
+		for (; j > 0 && comesBefore(edge, active[j - 1]); j--) {
+			active[j] = active[j - 1];
+		}
+
+		active[j] = edge;
+	}
+
+	std::vector<int>& stack = this->surface_stack;
+	stack.clear();
+	double span_start = 0;
+
+	for (int index : active) {
+		Edge& edge = edges[index];
+		Surface& surface = this->surfaces[edge.surface];
+
+		if (edge.entering) {
+			if (++surface.crossings != 1) {
+				continue;
+			}
+
+			if (stack.empty()) {
+				stack.push_back(edge.surface);
+				span_start = edge.x;
+			} else if (this->isNearer(edge.surface, stack.back(), edge.x, y)) {
+				// the top surface is hidden from here on
+				this->drawSpan(stack.back(), y, span_start, edge.x);
+				stack.push_back(edge.surface);
+				span_start = edge.x;
+			} else {
+				// it's hidden, but it might be uncovered further along
+				size_t position = stack.size() - 1;
+
+				while (position > 0 && this->isNearer(stack[position - 1], edge.surface, edge.x, y)) {
+					position--;
+				}
+
+				stack.insert(stack.begin() + position, edge.surface);
+			}
+		} else {
+			if (--surface.crossings != 0) {
+				continue;
+			}
+
+			if (stack.back() == edge.surface) {
+				// whatever is next nearest shows from here on
+				this->drawSpan(edge.surface, y, span_start, edge.x);
+				stack.pop_back();
+				span_start = edge.x;
+			} else {
+				stack.erase(std::find(stack.begin(), stack.end(), edge.surface));
+			}
+		}
+	}
+
+	// move on to the next scanline, dropping the edges that end here
+	size_t kept = 0;
+
+	for (int index : active) {
+		Edge& edge = edges[index];
+
+		if (y + 1 < edge.y_end) {
+			edge.x += edge.x_step;
+			active[kept++] = index;
+		}
+	}
+
+	active.resize(kept);
+}
+
+// compared where an edge crosses the scanline, so surfaces that meet there
+// have the same depth, and the one that gets nearer to the right is in front
+bool SpanBuffer::isNearer(int surface, int other, double x, double y) {
+	const Gradient& depth = this->surfaces[surface].depth;
+	const Gradient& other_depth = this->surfaces[other].depth;
+
+	double difference = depth.at(x, y) - other_depth.at(x, y);
+
+	if (fabs(difference) <= kSameDepthEpsilon * fabs(depth.at(x, y))) {
+		return depth.step_x > other_depth.step_x;
+	}
+
+	return difference > 0;
+}
+
+// draws the pixels from start_x up to (but not including) end_x
+void SpanBuffer::drawSpan(int surface_index, int y, double start_x, double end_x) {
+	int start = std::max(0, (int)ceil(start_x));
+	int end = std::min((int)device::getXRes(), (int)ceil(end_x));
+
+	if (start >= end) {
+		return;
+	}
+
+	Surface& surface = this->surfaces[surface_index];
+
+	surface.triangle.drawShadedLine(
+			y,
+			start,
+			end,
+			surface.shade.at(start, y),
+			surface.shade.at(end, y),
+			surface.inv_z.at(start, y),
+			surface.inv_z.at(end, y),
+			surface.inv_u.at(start, y),
+			surface.inv_v.at(start, y),
+			surface.inv_u.at(end, y),
+			surface.inv_v.at(end, y),
+			surface.mip_level);
+
+	this->span_count++;
+}
@@ -0,0 +1,96 @@
+#ifndef BUFFDOG_SPAN_BUFFER
+#define BUFFDOG_SPAN_BUFFER
+
+#include <vector>
+
+#include "triangle.h"
+
+
+// Hidden surface removal for static geometry, the way Quake did it.  Instead
+// of drawing triangles one after another and depth testing every pixel, all
+// of them are queued up, then each scanline walks the triangles' edges in
+// order of x, keeping a stack of the triangles that cover the current pixel
+// sorted by depth.  Only the nearest triangle's part of each scanline is
+// drawn, so every pixel is shaded exactly once, no matter how many triangles
+// are behind it.
+// Depths are only compared where edges start, so triangles must not pass
+// through each other, like the faces of a BSP world.  Translucent triangles
+// don't hide anything, so they can't be drawn this way.
+// The spans still write the z buffer, so other models can be drawn over them.
+struct SpanBuffer {
+	// the triangle's texture must stay alive until the next flush()
+	void addTriangle(const Triangle2D& triangle);
+
+	// draws everything that has been added since the last flush
+	void flush();
+
+	// how many spans the last flush() drew
+	int spanCount() {
+		return this->span_count;
+	}
+
+private:
+	// a value that's linear in screen space, at (x, y) it's
+	// at_origin + x * step_x + y * step_y
+	struct Gradient {
+		double at_origin;
+		double step_x;
+		double step_y;
+
+		double at(double x, double y) const {
+			return this->at_origin + x * this->step_x + y * this->step_y;
+		}
+	};
+
+	struct Surface {
+		Triangle2D triangle;
+		int mip_level;
+
+		// larger is closer, like the z buffer
+		Gradient depth;
+		Gradient inv_z;
+		Gradient shade;
+		Gradient inv_u;
+		Gradient inv_v;
+
+		// entering edges add one and leaving edges take one away, so that an
+		// edge that's crossed out of order can't leave it on the stack
+		int crossings;
+	};
+
+	struct Edge {
+		double x; // on the current scanline
+		double x_step;
+		int y_end; // the first scanline it doesn't cover
+		int surface;
+		bool entering; // the surface is to the right of it
+		int next; // the next edge that starts on the same scanline, or -1
+	};
+
+	std::vector<Surface> surfaces;
+	std::vector<Edge> edges;
+
+	// the first edge that starts on each scanline, or -1
+	std::vector<int> scanline_edges;
+
+	// the edges crossing the current scanline, in order of x
+	std::vector<int> active_edges;
+
+	// the surfaces covering the current pixel, nearest last
+	std::vector<int> surface_stack;
+
+	int span_count = 0;
+
+	// the gradient of a value that's f0, f1 and f2 at p0, p1 and p2, where area
+	// is twice the triangle's signed area, and the points and the area are in
+	// subpixels, see SUBPIXEL_BITS
+	static Gradient gradientFrom(
+			Point p0, Point p1, Point p2, double f0, double f1, double f2, double area);
+
+	void addEdge(Point start, Point end, Point opposite, int surface);
+	void drawScanline(int y);
+	bool isNearer(int surface, int other, double x, double y);
+	void drawSpan(int surface_index, int y, double start_x, double end_x);
+};
+
+#endif
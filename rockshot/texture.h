@@ -1,10 +1,235 @@
 #ifndef BUFFDOG_TEXTURE
 #define BUFFDOG_TEXTURE
 
-#include "../vector.h"
+#include <cmath>
+#include <cstdint>
+#include <vector>
 
+
+// lighting is applied to texels as an integer fraction of this, see shadeTexel()
+constexpr int kShadeOne = 256;
+
+// lighting beyond full intensity is clamped, since channels can't go past 255
+inline int clampShade(int shade) {
+	return shade < 0 ? 0 : (shade > kShadeOne ? kShadeOne : shade);
+}
+
+// converts a lighting intensity into a shade for shadeTexel()
+inline int shadeFromIntensity(double intensity) {
+	return clampShade((int)(intensity * kShadeOne));
+}
+
+// multiplies each channel of a texel (or any color, see
+// device::getColorValue()) by shade / kShadeOne
+// red and blue are multiplied together, since a channel multiplied by at most
+// 256 fits in 16 bits
+inline uint32_t shadeTexel(uint32_t texel, int shade) {
+	uint32_t red_blue = (((texel & 0xff00ff00) >> 8) * shade) & 0xff00ff00;
+	uint32_t green = ((((texel >> 16) & 0xff) * shade) & 0xff00) << 8;
+
+	return red_blue | green;
+}
+
+// packs a color into a texel, the same format as device::getColorValue()
+inline uint32_t texelFromRGB(unsigned char red, unsigned char green, unsigned char blue) {
+	return ((uint32_t)red << 24) | ((uint32_t)green << 16) | ((uint32_t)blue << 8);
+}
+
+// set this to 0 to always sample the full size texture
+#ifndef USE_MIPMAPS
+#define USE_MIPMAPS 1
+#endif
+
+// one image in a texture's mip chain, see Texture
+struct MipLevel {
+	size_t offset; // into Texture::texels
+	int width_shift;
+	int u_mask;
+	int v_mask;
+
+	// texel coordinates are width * u and height * v, so that 0 to 1 covers the
+	// whole level and each texel covers 1 / width of it, and the coordinates are
+	// floored so that the level tiles the same way on both sides of 0
+	double u_scale;
+	double v_scale;
+};
+
+// Textures are stored as 32 bit texels that are already in the framebuffer's
+// color format, so drawing a texel is a lookup and an integer multiply for
+// lighting, with no floating point color math.
+// Both dimensions are powers of two, so that coordinates outside of 0 to 1
+// wrap around with a mask.  Images of other sizes are resampled to the
+// nearest power of two when they're loaded.
+// Each texture has a chain of mip levels, each half the size of the last, so
+// that distant triangles can sample from a smaller image that fits in cache
+// (and doesn't shimmer as much), see Triangle2D::mipLevel().
 struct Texture {
-	virtual Vector vectorColorFromUV(double u, double v) = 0;
+	// every level's texels, the largest first
+	std::vector<uint32_t> texels;
+	std::vector<MipLevel> levels;
+
+	// the size of the largest level
+	int width = 0;
+	int height = 0;
+
+	// the row at v = 0 first
+	// color_at(x, y) gives the color of the image at (x, y) out of image_width
+	// by image_height, in the framebuffer's format
+	// the smaller mip levels are generated by averaging blocks of 2 x 2 texels,
+	// all the way down to 1 x 1, or only the first max_level_count levels, e.g.
+	// for atlases whose smallest levels would average separate images together
+	template <typename ColorAt>
+	void setTexels(int image_width, int image_height, ColorAt color_at, int max_level_count = 0) {
+		int width_shift = nearestPowerOfTwoShift(image_width);
+		int height_shift = nearestPowerOfTwoShift(image_height);
+		int level_count = 1 + (width_shift > height_shift ? width_shift : height_shift);
+
+		if (max_level_count > 0 && level_count > max_level_count) {
+			level_count = max_level_count;
+		}
+
+		this->setUpLevels(width_shift, height_shift, level_count);
+		this->resample(0, image_width, image_height, color_at);
+
+		for (size_t level = 1; level < this->levels.size(); level++) {
+			this->downsample(level);
+		}
+	}
+
+	// for images that come with their own mip levels, like Quake's miptex
+	// color_at(level, x, y) gives the color of each level, where level is
+	// image_width >> level by image_height >> level
+	template <typename ColorAt>
+	void setMipTexels(
+			int image_width, int image_height, int level_count, ColorAt color_at) {
+		this->setUpLevels(
+				nearestPowerOfTwoShift(image_width),
+				nearestPowerOfTwoShift(image_height),
+				level_count);
+
+		for (int level = 0; level < level_count; level++) {
+			int level_width = image_width >> level;
+			int level_height = image_height >> level;
+
+			this->resample(
+					level,
+					level_width > 0 ? level_width : 1,
+					level_height > 0 ? level_height : 1,
+					[&color_at, level](int x, int y) { return color_at(level, x, y); });
+		}
+	}
+
+	uint32_t texelAt(double u, double v, int level = 0) const {
+		const MipLevel& mip = this->levels[level];
+
+		int x = (int)floor(u * mip.u_scale) & mip.u_mask;
+		int y = (int)floor(v * mip.v_scale) & mip.v_mask;
+
+		return this->texels[mip.offset + (y << mip.width_shift) + x];
+	}
+
+	// the texel at (x, y) of the largest level, wrapping around like texelAt()
+	uint32_t texel(int x, int y) const {
+		const MipLevel& mip = this->levels[0];
+
+		return this->texels[((y & mip.v_mask) << mip.width_shift) + (x & mip.u_mask)];
+	}
+
+	static int nearestPowerOfTwoShift(int size) {
+		int shift = 0;
+
+		while ((1 << (shift + 1)) <= size) {
+			shift++;
+		}
+
+		// round up when size is at least halfway to the next power of two
+		if (size - (1 << shift) >= (1 << shift) / 2) {
+			shift++;
+		}
+
+		return shift;
+	}
+
+private:
+	void setUpLevels(int width_shift, int height_shift, int level_count) {
+		this->width = 1 << width_shift;
+		this->height = 1 << height_shift;
+		this->levels.resize(level_count);
+
+		size_t offset = 0;
+
+		for (int level = 0; level < level_count; level++) {
+			MipLevel& mip = this->levels[level];
+			int level_width_shift = width_shift > level ? width_shift - level : 0;
+			int level_height_shift = height_shift > level ? height_shift - level : 0;
+
+			mip.offset = offset;
+			mip.width_shift = level_width_shift;
+			mip.u_mask = (1 << level_width_shift) - 1;
+			mip.v_mask = (1 << level_height_shift) - 1;
+			mip.u_scale = mip.u_mask + 1;
+			mip.v_scale = mip.v_mask + 1;
+
+			offset += (size_t)1 << (level_width_shift + level_height_shift);
+		}
+
+		this->texels.resize(offset);
+	}
+
+	// nearest neighbor resampling of an image into a level
+	template <typename ColorAt>
+	void resample(int level, int image_width, int image_height, ColorAt color_at) {
+		MipLevel& mip = this->levels[level];
+		int level_width = mip.u_mask + 1;
+		int level_height = mip.v_mask + 1;
+
+		for (int y = 0; y < level_height; y++) {
+			int image_y = (long long)y * image_height / level_height;
+
+			for (int x = 0; x < level_width; x++) {
+				int image_x = (long long)x * image_width / level_width;
+
+				this->texels[mip.offset + (y << mip.width_shift) + x] =
+						color_at(image_x, image_y);
+			}
+		}
+	}
+
+	// averages blocks of the level above into this level
+	void downsample(int level) {
+		MipLevel& mip = this->levels[level];
+		MipLevel& above = this->levels[level - 1];
+
+		// a dimension that's already down to 1 doesn't shrink any further
+		int step_x = above.u_mask > 0 ? 2 : 1;
+		int step_y = above.v_mask > 0 ? 2 : 1;
+
+		for (int y = 0; y <= mip.v_mask; y++) {
+			for (int x = 0; x <= mip.u_mask; x++) {
+				uint32_t sums[3] = {0, 0, 0};
+				uint32_t count = 0;
+
+				for (int dy = 0; dy < step_y; dy++) {
+					for (int dx = 0; dx < step_x; dx++) {
+						uint32_t texel = this->texels[
+								above.offset
+								+ ((y * step_y + dy) << above.width_shift)
+								+ x * step_x + dx];
+
+						sums[0] += texel >> 24;
+						sums[1] += (texel >> 16) & 0xff;
+						sums[2] += (texel >> 8) & 0xff;
+						count++;
+					}
+				}
+
+				this->texels[mip.offset + (y << mip.width_shift) + x] = texelFromRGB(
+						(sums[0] + count / 2) / count,
+						(sums[1] + count / 2) / count,
+						(sums[2] + count / 2) / count);
+			}
+		}
+	}
 };
 
 #endif
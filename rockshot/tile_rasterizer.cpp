@@ -0,0 +1,161 @@
+#include <algorithm>
+
+#include "../device.h"
+
+#include "tile_rasterizer.h"
+
+
+static_assert(
+		RASTER_TILE_SHIFT >= device::kDepthTileShift,
+		"tiles have to be made of whole depth tiles, so their threads don't share any");
+
+TileRasterizer::TileRasterizer(unsigned int thread_count) : next_tile(0) {
+	if (thread_count == 0) {
+		thread_count = std::thread::hardware_concurrency();
+	}
+
+	// the thread calling flush() draws tiles too
+	for (unsigned int i = 1; i < thread_count; i++) {
+		this->workers.emplace_back(&TileRasterizer::workerLoop, this);
+	}
+}
+
+TileRasterizer::~TileRasterizer() {
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->quitting = true;
+	}
+
+	this->work_ready.notify_all();
+
+	for (auto& worker : this->workers) {
+		worker.join();
+	}
+}
+
+unsigned int TileRasterizer::threadCount() {
+	return this->workers.size() + 1;
+}
+
+void TileRasterizer::addTriangle(const Triangle2D& triangle) {
+	this->triangles.push_back(triangle);
+}
+
+void TileRasterizer::flush(FillMethod fill_method) {
+	if (this->triangles.empty()) {
+		return;
+	}
+
+	this->fill_method = fill_method;
+
+	this->binTriangles();
+	this->next_tile = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->generation++;
+		this->busy_workers = this->workers.size();
+	}
+
+	this->work_ready.notify_all();
+
+	this->drawTiles();
+
+	std::unique_lock<std::mutex> lock(this->mutex);
+	this->work_done.wait(lock, [this] { return this->busy_workers == 0; });
+
+	this->triangles.clear();
+}
+
+void TileRasterizer::binTriangles() {
+	int x_res = device::getXRes();
+	int y_res = device::getYRes();
+
+	// the resolution can change between frames
+	this->tiles_x = (x_res + (1 << RASTER_TILE_SHIFT) - 1) >> RASTER_TILE_SHIFT;
+	this->tiles_y = (y_res + (1 << RASTER_TILE_SHIFT) - 1) >> RASTER_TILE_SHIFT;
+	this->bins.resize(this->tiles_x * this->tiles_y);
+
+	// clearing keeps each bin's memory around for the next frame
+	for (auto& bin : this->bins) {
+		bin.clear();
+	}
+
+	for (uint32_t i = 0; i < this->triangles.size(); i++) {
+		Triangle2D& triangle = this->triangles[i];
+
+		int min_x = std::min(triangle.p0.x, std::min(triangle.p1.x, triangle.p2.x));
+		int min_y = std::min(triangle.p0.y, std::min(triangle.p1.y, triangle.p2.y));
+		int max_x = std::max(triangle.p0.x, std::max(triangle.p1.x, triangle.p2.x));
+		int max_y = std::max(triangle.p0.y, std::max(triangle.p1.y, triangle.p2.y));
+
+		// clipping should keep triangles on screen, but just in case
+		min_x = std::max(min_x, 0);
+		min_y = std::max(min_y, 0);
+		max_x = std::min(max_x, x_res - 1);
+		max_y = std::min(max_y, y_res - 1);
+
+		for (int tile_y = min_y >> RASTER_TILE_SHIFT; tile_y <= max_y >> RASTER_TILE_SHIFT; tile_y++) {
+			for (int tile_x = min_x >> RASTER_TILE_SHIFT; tile_x <= max_x >> RASTER_TILE_SHIFT; tile_x++) {
+				this->bins[tile_y * this->tiles_x + tile_x].push_back(i);
+			}
+		}
+	}
+}
+
+void TileRasterizer::drawTiles() {
+	int tile_count = this->tiles_x * this->tiles_y;
+	int x_res = device::getXRes();
+	int y_res = device::getYRes();
+
+	// threads grab the next undrawn tile until they're all taken, which keeps
+	// them busy even when some tiles have far more triangles than others
+	for (int tile = this->next_tile++; tile < tile_count; tile = this->next_tile++) {
+		int min_x = (tile % this->tiles_x) << RASTER_TILE_SHIFT;
+		int min_y = (tile / this->tiles_x) << RASTER_TILE_SHIFT;
+		int max_x = std::min(min_x + (1 << RASTER_TILE_SHIFT), x_res) - 1;
+		int max_y = std::min(min_y + (1 << RASTER_TILE_SHIFT), y_res) - 1;
+
+		if (this->fill_method == FillMethod::edge_function) {
+			for (uint32_t i : this->bins[tile]) {
+				this->triangles[i].fillEdgeFunction(min_x, min_y, max_x, max_y);
+			}
+		} else {
+			for (uint32_t i : this->bins[tile]) {
+				this->triangles[i].fillBarycentric(min_x, min_y, max_x, max_y);
+			}
+		}
+	}
+}
+
+void TileRasterizer::workerLoop() {
+	uint64_t last_generation = 0;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->work_ready.wait(lock, [this, last_generation] {
+				return this->quitting || this->generation != last_generation;
+			});
+
+			if (this->quitting) {
+				return;
+			}
+
+			last_generation = this->generation;
+		}
+
+		this->drawTiles();
+
+		bool last_to_finish;
+
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			last_to_finish = --this->busy_workers == 0;
+		}
+
+		if (last_to_finish) {
+			this->work_done.notify_one();
+		}
+	}
+}
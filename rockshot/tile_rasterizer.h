@@ -0,0 +1,78 @@
+#ifndef BUFFDOG_TILE_RASTERIZER
+#define BUFFDOG_TILE_RASTERIZER
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "triangle.h"
+
+
+// A binning rasterizer.  Projected triangles are queued up over the whole
+// frame, sorted into bins for each screen tile that they overlap, then the
+// tiles are drawn in parallel.  Each tile is only ever drawn by one thread, so
+// nothing needs to lock the framebuffer or the z buffer, and triangles are
+// drawn in the order they were added within each tile.
+// Tiles are made of whole depth tiles (see device::tileFarthestDepth()), and
+// each triangle is only tested against the hierarchical z buffer inside the
+// tile being drawn, so that's never shared between threads either.
+
+// tiles are 64 x 64 pixels
+#define RASTER_TILE_SHIFT 6
+
+// the number of threads drawing tiles, including the one calling flush()
+// 0 means one per hardware thread
+#ifndef RASTER_THREADS
+#define RASTER_THREADS 0
+#endif
+
+
+struct TileRasterizer {
+	// anything other than 0 starts that many threads, see RASTER_THREADS
+	explicit TileRasterizer(unsigned int thread_count = RASTER_THREADS);
+	~TileRasterizer();
+
+	TileRasterizer(const TileRasterizer&) = delete;
+	TileRasterizer& operator=(const TileRasterizer&) = delete;
+
+	unsigned int threadCount();
+
+	// the triangle's texture must stay alive until the next flush()
+	void addTriangle(const Triangle2D& triangle);
+
+	// draws everything that has been added since the last flush, and waits for
+	// it to finish
+	// scanline filling can't be limited to a tile, so it falls back to
+	// barycentric
+	void flush(FillMethod fill_method);
+
+private:
+	std::vector<Triangle2D> triangles;
+	FillMethod fill_method = FillMethod::edge_function;
+
+	// bins[tile] has the indices of the triangles that overlap the tile
+	std::vector<std::vector<uint32_t>> bins;
+	int tiles_x = 0;
+	int tiles_y = 0;
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable work_ready;
+	std::condition_variable work_done;
+
+	// incremented once per flush, so sleeping workers know there's new work
+	uint64_t generation = 0;
+	unsigned int busy_workers = 0;
+	bool quitting = false;
+
+	std::atomic<int> next_tile;
+
+	void binTriangles();
+	void drawTiles();
+	void workerLoop();
+};
+
+#endif
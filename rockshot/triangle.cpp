@@ -3,11 +3,122 @@
 
 #include "triangle.h"
 
+// fillEdgeFunction() tests 8 pixels at a time with AVX2, 4 with SSE2, or falls
+// back to one at a time
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define EDGE_SIMD_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define EDGE_SIMD_WIDTH 4
+#else
+#define EDGE_SIMD_WIDTH 1
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include <atomic>
+#include <utility>
+
 
 int min(int a, int b) { return (a < b ? a : b); }
 int max(int a, int b) { return (a > b ? a : b); }
 
 
+std::atomic<uint64_t> shaded_pixels(0);
+std::atomic<uint64_t> occluded_triangles(0);
+
+uint64_t shadedPixelCount() {
+	return shaded_pixels.load();
+}
+
+void resetShadedPixelCount() {
+	shaded_pixels = 0;
+}
+
+uint64_t occludedTriangleCount() {
+	return occluded_triangles.load();
+}
+
+void resetOccludedTriangleCount() {
+	occluded_triangles = 0;
+}
+
+// counts the pixels one fill shades and adds them to the total when it's
+// done, so that the tiles' threads only touch the atomic once per triangle
+// without COUNT_OVERDRAW this compiles away to nothing
+struct ShadedPixelCounter {
+#if COUNT_OVERDRAW
+	uint64_t count = 0;
+
+	~ShadedPixelCounter() {
+		if (this->count > 0) {
+			shaded_pixels += this->count;
+		}
+	}
+
+	void add() {
+		this->count++;
+	}
+#else
+	void add() {}
+#endif
+};
+
+// for fills that depth test a row's pixels left to right, tracks the farthest
+// depth tested in each depth tile along the row, and raises the tile's row
+// (see device::raiseDepthTileRow()) once every one of its pixels has been
+// tested, so fills that don't go a span at a time can raise tiles too
+// without USE_HIERARCHICAL_Z this compiles away to nothing
+struct DepthTileRowTracker {
+#if USE_HIERARCHICAL_Z
+	int x_res = device::getXRes();
+	int y = -1;
+	int tile_x = -1;
+	int first_x = 0;
+	int next_x = 0;
+	device::depth_t farthest = 0;
+
+	void test(int x, int y, device::depth_t depth) {
+		int tile_x = x >> device::kDepthTileShift;
+
+		// a gap in the row means some of the tile's pixels weren't tested
+		if (tile_x != this->tile_x || y != this->y || x != this->next_x) {
+			this->finishRow();
+
+			this->tile_x = tile_x;
+			this->y = y;
+			this->first_x = x;
+			this->farthest = depth;
+		} else if (depth < this->farthest) {
+			this->farthest = depth;
+		}
+
+		this->next_x = x + 1;
+	}
+
+	void finishRow() {
+		if (this->tile_x < 0) {
+			return;
+		}
+
+		int tile_start = this->tile_x << device::kDepthTileShift;
+		int tile_end = min(tile_start + device::kDepthTileSize, this->x_res);
+
+		if (this->first_x == tile_start && this->next_x == tile_end) {
+			device::raiseDepthTileRow(this->tile_x, this->y, this->farthest);
+		}
+
+		this->tile_x = -1;
+	}
+#else
+	void test(int x, int y, device::depth_t depth) {}
+	void finishRow() {}
+#endif
+};
+
 int colorFromVector(Vector vec) {
 	return device::getColorValue(vec.x, vec.y, vec.z);
 }
@@ -20,6 +131,39 @@ void drawPoint(Point point, int color) {
 	}
 }
 
+device::depth_t nearestDepth(double inv_z1, double inv_z2) {
+	device::depth_t depth1 = device::depthFromInvZ(inv_z1);
+	device::depth_t depth2 = device::depthFromInvZ(inv_z2);
+
+	return depth1 > depth2 ? depth1 : depth2;
+}
+
+bool depthTilesOcclude(
+		int min_x, int min_y, int max_x, int max_y, device::depth_t nearest) {
+	// only the on screen part matters
+	min_x = max(min_x, 0);
+	min_y = max(min_y, 0);
+	max_x = min(max_x, device::getXRes() - 1);
+	max_y = min(max_y, device::getYRes() - 1);
+
+	if (min_x > max_x || min_y > max_y) {
+		return false;
+	}
+
+	int max_tile_x = max_x >> device::kDepthTileShift;
+	int max_tile_y = max_y >> device::kDepthTileShift;
+
+	for (int tile_y = min_y >> device::kDepthTileShift; tile_y <= max_tile_y; tile_y++) {
+		for (int tile_x = min_x >> device::kDepthTileShift; tile_x <= max_tile_x; tile_x++) {
+			if (nearest > device::tileFarthestDepth(tile_x, tile_y)) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
 void Triangle2D::drawShadedLine(
 		int y,
 		int x1,
@@ -31,7 +175,10 @@ void Triangle2D::drawShadedLine(
 		double inv_u1,
 		double inv_v1,
 		double inv_u2,
-		double inv_v2) {
+		double inv_v2,
+		int mip_level) {
+	ShadedPixelCounter shaded;
+
 	int start_x;
 	int end_x;
 
@@ -83,30 +230,157 @@ void Triangle2D::drawShadedLine(
 		inv_vq = (inv_v1 - inv_v2) / dx;
 	}
 
-	for (int x = start_x; x < end_x; x++) {
-		if (!this->translucency || (x + y) % this->translucency == 0) {
-			double& z_buffer_value = device::zBufferAt(x, y);
+	int x_res = device::getXRes();
 
-			if (inv_z < z_buffer_value) {
-				uint32_t final_color;
+	// triangles can reach past the edges of the screen into the guard band (see
+	// Renderer::guard_band), so only the part of the span that's on it is drawn
+	if (y < 0 || y >= (int)device::getYRes()) {
+		return;
+	}
 
-				if (this->texture) {
-					Vector vec_color = this->texture->vectorColorFromUV(inv_u / inv_z, inv_v / inv_z);
-					final_color = colorFromVector(vec_color.scalarMultiply(h));
+	if (start_x < 0) {
+		h -= a * start_x;
+		inv_z -= q * start_x;
+		inv_u -= inv_uq * start_x;
+		inv_v -= inv_vq * start_x;
+		start_x = 0;
+	}
+
+	if (end_x > x_res) {
+		end_x = x_res;
+	}
+
+	// lighting is stepped in fixed point, with 8 more fractional bits than a
+	// shade (see shadeTexel())
+	int shade = (int)(h * (kShadeOne << 8));
+	int shade_step = (int)(a * (kShadeOne << 8));
+	uint32_t flat_color = colorFromVector(this->color);
+
+	int tile_y = y >> device::kDepthTileShift;
+
+	// with perspective spans, u and v are only divided by z every
+	// perspective_span pixels, and stepped linearly in between (like Quake)
+	bool perspective_spans = this->texture && this->perspective_span > 1;
+	double inverse_span = perspective_spans ? 1.0 / this->perspective_span : 0;
+	int span_remaining = 0;
+	bool span_continues = false;
+	double u = 0;
+	double v = 0;
+	double du = 0;
+	double dv = 0;
+	double span_end_u = 0;
+	double span_end_v = 0;
+
+	// the span is drawn in segments that each lie in one depth tile, so that
+	// segments that are entirely hidden can be skipped
+	for (int x = start_x; x < end_x;) {
+		int segment_end = (x | (device::kDepthTileSize - 1)) + 1;
+
+		if (segment_end > end_x) {
+			segment_end = end_x;
+		}
+
+#if USE_HIERARCHICAL_Z
+		int tile_x = x >> device::kDepthTileShift;
+
+		// 1/z is linear along the span, so the nearest point of the segment is at
+		// one of its ends
+		int segment_length = segment_end - x;
+		device::depth_t segment_nearest = nearestDepth(
+				inv_z, inv_z + q * (segment_length - 1));
+
+		if (segment_nearest <= device::tileFarthestDepth(tile_x, tile_y)) {
+			shade += shade_step * segment_length;
+			inv_z += q * segment_length;
+
+			inv_u += inv_uq * segment_length;
+			inv_v += inv_vq * segment_length;
+
+			span_remaining = 0;
+			span_continues = false;
+
+			x = segment_end;
+			continue;
+		}
+
+		// every pixel of the tile's row is depth tested unless the span doesn't
+		// cover it or is translucent, see device::raiseDepthTileRow()
+		bool covers_tile_row =
+				(x & (device::kDepthTileSize - 1)) == 0
+				&& (segment_end - x == device::kDepthTileSize || segment_end == x_res)
+				&& this->translucency <= 1;
+		device::depth_t segment_farthest = segment_nearest;
+#endif
+
+		for (; x < segment_end; x++) {
+			if (perspective_spans && span_remaining == 0) {
+				if (span_continues) {
+					u = span_end_u;
+					v = span_end_v;
 				} else {
-					final_color = colorFromVector(this->color.scalarMultiply(h));
+					u = inv_u / inv_z;
+					v = inv_v / inv_z;
+				}
+
+				span_remaining = min(this->perspective_span, end_x - x);
+
+				double end_z = 1 / (inv_z + q * span_remaining);
+				span_end_u = (inv_u + inv_uq * span_remaining) * end_z;
+				span_end_v = (inv_v + inv_vq * span_remaining) * end_z;
+
+				double step_scale = span_remaining == this->perspective_span
+						? inverse_span
+						: 1.0 / span_remaining;
+				du = (span_end_u - u) * step_scale;
+				dv = (span_end_v - v) * step_scale;
+
+				span_continues = true;
+			}
+
+			if (!this->translucency || (x + y) % this->translucency == 0) {
+				device::depth_t depth = device::depthFromInvZ(inv_z);
+				device::depth_t& z_buffer_value = device::zBufferAt(x, y);
+
+#if USE_HIERARCHICAL_Z
+				if (depth < segment_farthest) {
+					segment_farthest = depth;
 				}
-				device::setPixel(x, y, final_color);
+#endif
+
+				if (depth > z_buffer_value) {
+					uint32_t texel;
+
+					if (perspective_spans) {
+						texel = this->texture->texelAt(u, v, mip_level);
+					} else if (this->texture) {
+						texel = this->texture->texelAt(inv_u / inv_z, inv_v / inv_z, mip_level);
+					} else {
+						texel = flat_color;
+					}
 
-				z_buffer_value = inv_z;
+					device::setPixel(x, y, shadeTexel(texel, clampShade(shade >> 8)));
+					shaded.add();
+
+					z_buffer_value = depth;
+				}
 			}
-		}
 
-		h += a;
-		inv_z += q;
+			shade += shade_step;
+			inv_z += q;
+
+			inv_u += inv_uq;
+			inv_v += inv_vq;
 
-		inv_u += inv_uq;
-		inv_v += inv_vq;
+			u += du;
+			v += dv;
+			span_remaining--;
+		}
+
+#if USE_HIERARCHICAL_Z
+		if (covers_tile_row) {
+			device::raiseDepthTileRow(tile_x, y, segment_farthest);
+		}
+#endif
 	}
 }
 
@@ -154,7 +428,80 @@ void Triangle2D::fill() {
 	}
 }
 
+bool Triangle2D::isOccluded() {
+	return this->isOccluded(0, 0, device::getXRes() - 1, device::getYRes() - 1);
+}
+
+bool Triangle2D::isOccluded(int min_x, int min_y, int max_x, int max_y) {
+#if USE_HIERARCHICAL_Z
+	// 1/z is linear across the triangle, so its nearest point is a vertex
+	device::depth_t nearest = nearestDepth(this->invZ0, this->invZ1);
+	device::depth_t depth2 = device::depthFromInvZ(this->invZ2);
+
+	if (depth2 > nearest) {
+		nearest = depth2;
+	}
+
+	bool occluded = depthTilesOcclude(
+			max(min_x, min(this->p0.x, min(this->p1.x, this->p2.x))),
+			max(min_y, min(this->p0.y, min(this->p1.y, this->p2.y))),
+			min(max_x, max(this->p0.x, max(this->p1.x, this->p2.x))),
+			min(max_y, max(this->p0.y, max(this->p1.y, this->p2.y))),
+			nearest);
+
+	if (occluded) {
+		occluded_triangles++;
+	}
+
+	return occluded;
+#else
+	return false;
+#endif
+}
+
+int Triangle2D::mipLevel() {
+#if USE_MIPMAPS
+	if (!this->texture || this->texture->levels.size() < 2) {
+		return 0;
+	}
+
+	// how many texels the triangle covers for each pixel it covers
+	double screen_area = fabs(
+			(double)(this->p1.x - this->p0.x) * (this->p2.y - this->p0.y)
+			- (double)(this->p2.x - this->p0.x) * (this->p1.y - this->p0.y));
+	double texel_area = fabs(
+			(this->u1 - this->u0) * (this->v2 - this->v0)
+			- (this->u2 - this->u0) * (this->v1 - this->v0))
+			* this->texture->width * this->texture->height;
+
+	if (screen_area < 1) {
+		screen_area = 1;
+	}
+
+	// each level has a quarter of the texels of the one above it, pick the one
+	// nearest to one texel per pixel, by rounding half of log2 of the ratio
+	double texels_per_pixel = texel_area / screen_area;
+	int last_level = this->texture->levels.size() - 1;
+	int level = 0;
+
+	while (texels_per_pixel > 2 && level < last_level) {
+		texels_per_pixel /= 4;
+		level++;
+	}
+
+	return level;
+#else
+	return 0;
+#endif
+}
+
 void Triangle2D::fillShaded() {
+	if (this->isOccluded()) {
+		return;
+	}
+
+	int mip_level = this->mipLevel();
+
 	// sort from highest (p2) to lowest (p0)
 	Point temp;
 	double htemp;
@@ -253,7 +600,8 @@ void Triangle2D::fillShaded() {
 				inv_u0,
 				inv_v0,
 				inv_u1,
-				inv_v1);
+				inv_v1,
+				mip_level);
 
 		this->drawShadedLine(
 				this->p2.y,
@@ -266,7 +614,8 @@ void Triangle2D::fillShaded() {
 				inv_u1,
 				inv_v1,
 				inv_u2,
-				inv_v2);
+				inv_v2,
+				mip_level);
 		return;
 	}
 
@@ -309,7 +658,8 @@ void Triangle2D::fillShaded() {
 				inv_u0,
 				inv_v0,
 				inv_u1,
-				inv_v1);
+				inv_v1,
+				mip_level);
 
 	} else {
 		double m01 = (this->p1.x - this->p0.x) / dy01;
@@ -319,7 +669,7 @@ void Triangle2D::fillShaded() {
 		double vq01 = (inv_v1 - inv_v0) / dy01;
 
 		for (int y = this->p0.y; y < this->p1.y; y++) {
-			this->drawShadedLine(y, x01, x02, h01, h02, z01, z02, u01, v01, u02, v02);
+			this->drawShadedLine(y, x01, x02, h01, h02, z01, z02, u01, v01, u02, v02, mip_level);
 
 			x01 += m01;
 			x02 += m02;
@@ -352,7 +702,8 @@ void Triangle2D::fillShaded() {
 				inv_u1,
 				inv_v1,
 				inv_u2,
-				inv_v2);
+				inv_v2,
+				mip_level);
 	} else {
 		double m12 = (this->p2.x - this->p1.x) / dy12;
 		double a12 = (this->h2 - this->h1) / dy12;
@@ -361,7 +712,7 @@ void Triangle2D::fillShaded() {
 		double vq12 = (inv_v2 - inv_v1) / dy12;
 
 		for (int y = this->p1.y; y <= this->p2.y; y++) {
-			this->drawShadedLine(y, x12, x02, h12, h02, z12, z02, u12, v12, u02, v02);
+			this->drawShadedLine(y, x12, x02, h12, h02, z12, z02, u12, v12, u02, v02, mip_level);
 
 			x12 += m12;
 			x02 += m02;
@@ -382,6 +733,16 @@ void Triangle2D::fillShaded() {
 }
 
 void Triangle2D::fillBarycentric() {
+	this->fillBarycentric(0, 0, device::getXRes() - 1, device::getYRes() - 1);
+}
+
+void Triangle2D::fillBarycentric(int min_x, int min_y, int max_x, int max_y) {
+	ShadedPixelCounter shaded;
+
+	if (this->isOccluded(min_x, min_y, max_x, max_y)) {
+		return;
+	}
+
 	double inv_u0 = this->u0 * this->invZ0;
 	double inv_v0 = this->v0 * this->invZ0;
 
@@ -391,43 +752,404 @@ void Triangle2D::fillBarycentric() {
 	double inv_u2 = this->u2 * this->invZ2;
 	double inv_v2 = this->v2 * this->invZ2;
 
-	// define the bounding box containing the triangle
+	int mip_level = this->mipLevel();
+	uint32_t flat_color = colorFromVector(this->color);
+
+	// define the bounding box containing the triangle, limited to the given area
 	Point bmin = {
-			min(this->p0.x, min(this->p1.x, this->p2.x)),
-			min(this->p0.y, min(this->p1.y, this->p2.y))};
+			max(min_x, min(this->p0.x, min(this->p1.x, this->p2.x))),
+			max(min_y, min(this->p0.y, min(this->p1.y, this->p2.y)))};
 	Point bmax = {
-			max(this->p0.x, max(this->p1.x, this->p2.x)),
-			max(this->p0.y, max(this->p1.y, this->p2.y))};
+			min(max_x, max(this->p0.x, max(this->p1.x, this->p2.x))),
+			min(max_y, max(this->p0.y, max(this->p1.y, this->p2.y)))};
+
+	// the same cross product as getBarycentricWeights(), but its x and y
+	// components are linear in the pixel position, so they can be stepped
+	// across the bounding box with integer math, and only divided for pixels
+	// that are inside the triangle
+	long long edge_x_dx = this->p1.y - this->p0.y;
+	long long edge_x_dy = this->p0.x - this->p1.x;
+	long long edge_y_dx = this->p0.y - this->p2.y;
+	long long edge_y_dy = this->p2.x - this->p0.x;
+	long long area =
+			(long long)(this->p2.x - this->p0.x) * (this->p1.y - this->p0.y)
+			- (long long)(this->p1.x - this->p0.x) * (this->p2.y - this->p0.y);
+
+	if (area > -1 && area < 1) {
+		// degenerate
+		return;
+	}
 
-	for (int x = bmin.x; x <= bmax.x; x++) {
-		for (int y = bmin.y; y <= bmax.y; y++) {
-			Vector bc_weights = getBarycentricWeights(this->p0, this->p1, this->p2, x, y);
+	// the weights are ordered so that they're positive when the area is
+	int sign = area > 0 ? 1 : -1;
 
-			if (bc_weights.x < 0 || bc_weights.y < 0 || bc_weights.z < 0) {
+	long long row_edge_x =
+			(long long)(this->p1.x - this->p0.x) * (this->p0.y - bmin.y)
+			- (long long)(this->p0.x - bmin.x) * (this->p1.y - this->p0.y);
+	long long row_edge_y =
+			(long long)(this->p0.x - bmin.x) * (this->p2.y - this->p0.y)
+			- (long long)(this->p2.x - this->p0.x) * (this->p0.y - bmin.y);
+
+	DepthTileRowTracker depth_tiles;
+
+	// row by row, to walk the framebuffer and z buffer in memory order
+	for (int y = bmin.y; y <= bmax.y; y++) {
+		long long edge_x = row_edge_x;
+		long long edge_y = row_edge_y;
+
+		row_edge_x += edge_x_dy;
+		row_edge_y += edge_y_dy;
+
+		for (int x = bmin.x; x <= bmax.x; x++, edge_x += edge_x_dx, edge_y += edge_y_dx) {
+			if (edge_x * sign < 0
+					|| edge_y * sign < 0
+					|| (area - edge_x - edge_y) * sign < 0) {
 				continue;
 			}
 
+			if (this->translucency && (x + y) % this->translucency != 0) {
+				continue;
+			}
+
+			Vector bc_weights = {
+					1.0 - (double)(edge_x + edge_y) / area,
+					(double)edge_y / area,
+					(double)edge_x / area};
+
 			double h = this->h0 * bc_weights.x + this->h1 * bc_weights.y + this->h2 * bc_weights.z;
 			double inv_z = this->invZ0 * bc_weights.x + this->invZ1 * bc_weights.y + this->invZ2 * bc_weights.z;
 			double inv_u = inv_u0 * bc_weights.x + inv_u1 * bc_weights.y + inv_u2 * bc_weights.z;
 			double inv_v = inv_v0 * bc_weights.x + inv_v1 * bc_weights.y + inv_v2 * bc_weights.z;
 
-			double& z_buffer_value = device::zBufferAt(x, y);
+			device::depth_t depth = device::depthFromInvZ(inv_z);
+			device::depth_t& z_buffer_value = device::zBufferAt(x, y);
+
+			depth_tiles.test(x, y, depth);
+
+			if (depth > z_buffer_value) {
+				uint32_t texel = this->texture
+						? this->texture->texelAt(inv_u / inv_z, inv_v / inv_z, mip_level)
+						: flat_color;
+
+				device::setPixel(x, y, shadeTexel(texel, shadeFromIntensity(h)));
+				shaded.add();
+
+				z_buffer_value = depth;
+			}
+		}
+
+		depth_tiles.finishRow();
+	}
+}
+
+// the index of the lowest set bit, bits can't be 0
+int lowestSetBit(unsigned int bits) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, bits);
+	return index;
+#else
+	return __builtin_ctz(bits);
+#endif
+}
+
+// the values of fillEdgeFunction()'s three edge functions for the next
+// EDGE_SIMD_WIDTH pixels of a row
+struct EdgeLanes {
+#if EDGE_SIMD_WIDTH == 8
+	__m256i edges[3];
+	__m256i lane_offsets[3];
+	__m256i group_steps[3];
+
+	void setUp(const int32_t steps[3]) {
+		for (int i = 0; i < 3; i++) {
+			int32_t step = steps[i];
+			this->lane_offsets[i] = _mm256_setr_epi32(
+					0, step, 2 * step, 3 * step, 4 * step, 5 * step, 6 * step, 7 * step);
+			this->group_steps[i] = _mm256_set1_epi32(8 * step);
+		}
+	}
+
+	void startRow(const int32_t row_edges[3]) {
+		for (int i = 0; i < 3; i++) {
+			this->edges[i] = _mm256_add_epi32(
+					_mm256_set1_epi32(row_edges[i]), this->lane_offsets[i]);
+		}
+	}
+
+	// a bit for each pixel that's inside all three edges
+	unsigned int coverage() {
+		// the sign bit is set if any of the edge functions are negative
+		__m256i outside = _mm256_or_si256(
+				_mm256_or_si256(this->edges[0], this->edges[1]), this->edges[2]);
+
+		return ~_mm256_movemask_ps(_mm256_castsi256_ps(outside)) & 0xff;
+	}
+
+	void advance() {
+		for (int i = 0; i < 3; i++) {
+			this->edges[i] = _mm256_add_epi32(this->edges[i], this->group_steps[i]);
+		}
+	}
+#elif EDGE_SIMD_WIDTH == 4
+	__m128i edges[3];
+	__m128i lane_offsets[3];
+	__m128i group_steps[3];
+
+	void setUp(const int32_t steps[3]) {
+		for (int i = 0; i < 3; i++) {
+			int32_t step = steps[i];
+			this->lane_offsets[i] = _mm_setr_epi32(0, step, 2 * step, 3 * step);
+			this->group_steps[i] = _mm_set1_epi32(4 * step);
+		}
+	}
+
+	void startRow(const int32_t row_edges[3]) {
+		for (int i = 0; i < 3; i++) {
+			this->edges[i] = _mm_add_epi32(
+					_mm_set1_epi32(row_edges[i]), this->lane_offsets[i]);
+		}
+	}
+
+	unsigned int coverage() {
+		__m128i outside = _mm_or_si128(
+				_mm_or_si128(this->edges[0], this->edges[1]), this->edges[2]);
+
+		return ~_mm_movemask_ps(_mm_castsi128_ps(outside)) & 0xf;
+	}
+
+	void advance() {
+		for (int i = 0; i < 3; i++) {
+			this->edges[i] = _mm_add_epi32(this->edges[i], this->group_steps[i]);
+		}
+	}
+#else
+	int32_t edges[3];
+	int32_t steps[3];
+
+	void setUp(const int32_t steps[3]) {
+		for (int i = 0; i < 3; i++) {
+			this->steps[i] = steps[i];
+		}
+	}
+
+	void startRow(const int32_t row_edges[3]) {
+		for (int i = 0; i < 3; i++) {
+			this->edges[i] = row_edges[i];
+		}
+	}
+
+	unsigned int coverage() {
+		return (this->edges[0] | this->edges[1] | this->edges[2]) >= 0;
+	}
+
+	void advance() {
+		for (int i = 0; i < 3; i++) {
+			this->edges[i] += this->steps[i];
+		}
+	}
+#endif
+};
+
+void Triangle2D::fillEdgeFunction() {
+	this->fillEdgeFunction(0, 0, device::getXRes() - 1, device::getYRes() - 1);
+}
+
+void Triangle2D::fillEdgeFunction(int min_x, int min_y, int max_x, int max_y) {
+	ShadedPixelCounter shaded;
+
+	if (this->isOccluded(min_x, min_y, max_x, max_y)) {
+		return;
+	}
+
+	// the fixed point positions, see SUBPIXEL_BITS
+	Point points[3] = {this->s0, this->s1, this->s2};
+	double inv_z[3] = {this->invZ0, this->invZ1, this->invZ2};
+	double shades[3] = {this->h0, this->h1, this->h2};
+	double us[3] = {this->u0, this->u1, this->u2};
+	double vs[3] = {this->v0, this->v1, this->v2};
+
+	// in whole pixels, which are sampled at their top left corners like the
+	// other fills' vertices
+	Point bmin = {
+			min(this->p0.x, min(this->p1.x, this->p2.x)),
+			min(this->p0.y, min(this->p1.y, this->p2.y))};
+	Point bmax = {
+			max(this->p0.x, max(this->p1.x, this->p2.x)),
+			max(this->p0.y, max(this->p1.y, this->p2.y))};
+
+	// edge functions are up to 2 * width * height of the bounding box in fixed
+	// point, which has to fit in 32 bits (with a bit of room for the SIMD lanes
+	// that run past the bounding box)
+	long long box_area = (long long)(bmax.x - bmin.x + 1) * (bmax.y - bmin.y + 1);
+
+	if (box_area << (2 * SUBPIXEL_BITS) >= (1ll << 29)) {
+		this->fillBarycentric(min_x, min_y, max_x, max_y);
+		return;
+	}
+
+	long long area =
+			(long long)(points[1].x - points[0].x) * (points[2].y - points[0].y)
+			- (long long)(points[1].y - points[0].y) * (points[2].x - points[0].x);
+
+	if (area == 0) {
+		// degenerate
+		return;
+	}
+
+	// wind counterclockwise, so that the inside of every edge is positive
+	if (area < 0) {
+		std::swap(points[1], points[2]);
+		std::swap(inv_z[1], inv_z[2]);
+		std::swap(shades[1], shades[2]);
+		std::swap(us[1], us[2]);
+		std::swap(vs[1], vs[2]);
+		area = -area;
+	}
+
+	bmin.x = max(bmin.x, min_x);
+	bmin.y = max(bmin.y, min_y);
+	bmax.x = min(bmax.x, max_x);
+	bmax.y = min(bmax.y, max_y);
+
+	if (bmin.x > bmax.x || bmin.y > bmax.y) {
+		return;
+	}
+
+	// edges[i] is the edge opposite points[i], so it's also points[i]'s
+	// (unnormalized) barycentric weight
+	const int32_t one = 1 << SUBPIXEL_BITS;
+	int32_t corner_x = bmin.x * one;
+	int32_t corner_y = bmin.y * one;
+	int32_t corner_edges[3];
+	int32_t biases[3];
+	int32_t step_x[3];
+	int32_t step_y[3];
+
+	for (int i = 0; i < 3; i++) {
+		Point& a = points[(i + 1) % 3];
+		Point& b = points[(i + 2) % 3];
+
+		int32_t dx = b.x - a.x;
+		int32_t dy = b.y - a.y;
+
+		// top-left fill rule: pixels exactly on an edge belong to the triangle
+		// only if it's a top edge or a left edge, so that triangles sharing an
+		// edge don't both draw it.  This is y up and counterclockwise, so left
+		// edges go down and top edges go left.
+		bool top_left = dy < 0 || (dy == 0 && dx < 0);
+
+		corner_edges[i] = dx * (corner_y - a.y) - dy * (corner_x - a.x);
+		biases[i] = top_left ? 0 : -1;
+		step_x[i] = -dy * one;
+		step_y[i] = dx * one;
+	}
+
+	// 1/z, and everything else divided by z, is linear in screen space, so each
+	// is a plane over the pixels: value + x step * x + y step * y, relative to
+	// the bounding box's corner
+	double inv_area = 1.0 / area;
+	double z_plane[3] = {0, 0, 0};
+	double h_plane[3] = {0, 0, 0};
+	double u_plane[3] = {0, 0, 0};
+	double v_plane[3] = {0, 0, 0};
+
+	for (int i = 0; i < 3; i++) {
+		double edge_plane[3] = {
+				corner_edges[i] * inv_area,
+				step_x[i] * inv_area,
+				step_y[i] * inv_area};
+
+		for (int j = 0; j < 3; j++) {
+			z_plane[j] += edge_plane[j] * inv_z[i];
+			h_plane[j] += edge_plane[j] * shades[i] * inv_z[i];
+			u_plane[j] += edge_plane[j] * us[i] * inv_z[i];
+			v_plane[j] += edge_plane[j] * vs[i] * inv_z[i];
+		}
+	}
+
+	uint32_t flat_color = colorFromVector(this->color);
+	int mip_level = this->mipLevel();
 
-			if (inv_z < z_buffer_value) {
-				uint32_t final_color;
+	EdgeLanes lanes;
+	lanes.setUp(step_x);
+
+	int32_t row_edges[3];
+
+	for (int i = 0; i < 3; i++) {
+		row_edges[i] = corner_edges[i] + biases[i];
+	}
+
+	DepthTileRowTracker depth_tiles;
+
+	for (int y = bmin.y; y <= bmax.y; y++) {
+		int row = y - bmin.y;
+		bool entered_triangle = false;
+
+		lanes.startRow(row_edges);
+
+		for (int x = bmin.x; x <= bmax.x; x += EDGE_SIMD_WIDTH, lanes.advance()) {
+			unsigned int coverage = lanes.coverage();
+
+			if (!coverage) {
+				// triangles are convex, so once a row leaves it's done
+				if (entered_triangle) {
+					break;
+				}
+
+				continue;
+			}
+
+			entered_triangle = true;
+
+			// don't draw past the right of the bounding box
+			if (bmax.x - x + 1 < EDGE_SIMD_WIDTH) {
+				coverage &= (1u << (bmax.x - x + 1)) - 1;
+			}
+
+			for (; coverage; coverage &= coverage - 1) {
+				int lane = lowestSetBit(coverage);
+				int pixel_x = x + lane;
+
+				if (this->translucency && (pixel_x + y) % this->translucency != 0) {
+					continue;
+				}
+
+				int column = pixel_x - bmin.x;
+				double pixel_inv_z =
+						z_plane[0] + z_plane[1] * column + z_plane[2] * row;
+
+				device::depth_t depth = device::depthFromInvZ(pixel_inv_z);
+				device::depth_t& z_buffer_value = device::zBufferAt(pixel_x, y);
+
+				depth_tiles.test(pixel_x, y, depth);
+
+				if (depth <= z_buffer_value) {
+					continue;
+				}
+
+				double z = 1 / pixel_inv_z;
+				double h = (h_plane[0] + h_plane[1] * column + h_plane[2] * row) * z;
+				uint32_t texel = flat_color;
 
 				if (this->texture) {
-					Vector vec_color = texture->vectorColorFromUV(inv_u / inv_z, inv_v / inv_z);
-					final_color = colorFromVector(vec_color.scalarMultiply(h));
-				} else {
-					final_color = colorFromVector(color.scalarMultiply(h));
+					double u = (u_plane[0] + u_plane[1] * column + u_plane[2] * row) * z;
+					double v = (v_plane[0] + v_plane[1] * column + v_plane[2] * row) * z;
+
+					texel = this->texture->texelAt(u, v, mip_level);
 				}
 
-				device::setPixel(x, y, final_color);
+				device::setPixel(pixel_x, y, shadeTexel(texel, shadeFromIntensity(h)));
+				shaded.add();
 
-				z_buffer_value = inv_z;
+				z_buffer_value = depth;
 			}
 		}
+
+		depth_tiles.finishRow();
+
+		for (int i = 0; i < 3; i++) {
+			row_edges[i] += step_y[i];
+		}
 	}
 }
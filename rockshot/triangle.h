@@ -12,8 +12,40 @@
 // Logic for drawing 2D triangles
 
 
+// set this to 0 to depth test every pixel, instead of first rejecting whole
+// triangles and spans against the hierarchical z buffer (see
+// device::tileFarthestDepth())
+#ifndef USE_HIERARCHICAL_Z
+#define USE_HIERARCHICAL_Z 1
+#endif
+
+// counts every pixel the fills shade and write, to measure overdraw, see
+// shadedPixelCount()
+// each fill counts into a local and adds it to the total once, so it's cheap
+// enough to leave on, but setting this to 0 compiles it away
+#ifndef COUNT_OVERDRAW
+#define COUNT_OVERDRAW 1
+#endif
+
+// screen positions are projected in fixed point with this many fractional
+// bits (see Triangle2D::s0), which fillEdgeFunction() rasterizes with, so that
+// its edges move smoothly with the camera instead of a whole pixel at a time
+#define SUBPIXEL_BITS 4
+
+// the ways to fill a Triangle2D with its texture and lighting
+enum class FillMethod {
+	scanline, // fillShaded()
+	barycentric, // fillBarycentric()
+	edge_function // fillEdgeFunction()
+};
+
 int colorFromVector(Vector vec);
 
+// the pixel that a fixed point screen position (see SUBPIXEL_BITS) is in
+inline Point pixelFromSubpixel(Point subpixel) {
+	return Point{subpixel.x >> SUBPIXEL_BITS, subpixel.y >> SUBPIXEL_BITS};
+}
+
 // mostly for debugging
 void drawPoint(Point point, int color);
 
@@ -21,6 +53,17 @@ void drawPoint(Point point, int color);
 
 Vector getBarycentricWeights(Point p0, Point p1, Point p2, int x, int y);
 
+// pixels shaded since the last resetShadedPixelCount(), always 0 when
+// COUNT_OVERDRAW is 0
+uint64_t shadedPixelCount();
+void resetShadedPixelCount();
+
+// triangles rejected by Triangle2D::isOccluded() since the last
+// resetOccludedTriangleCount(), where the tiled fills count each tile's part
+// of a triangle separately
+uint64_t occludedTriangleCount();
+void resetOccludedTriangleCount();
+
 
 // stupid naming conventions:
 //   h represents lighting intensity
@@ -47,12 +90,37 @@ struct Triangle2D {
 	Texture* texture;
 	int translucency = 0;
 
+	// fillShaded() only does the perspective divide for texture coordinates
+	// every this many pixels, and interpolates linearly in between.  0 or 1
+	// divides at every pixel.
+	int perspective_span = 0;
+
+	// where p0, p1 and p2 really are, in fixed point with SUBPIXEL_BITS
+	// fractional bits, see pixelFromSubpixel()
+	// only fillEdgeFunction() uses these, the other fills work in whole pixels
+	Point s0 = {0, 0};
+	Point s1 = {0, 0};
+	Point s2 = {0, 0};
+
 	// draws a wireframe triangle using its color value
 	void draw();
 
 	// draws a filled triangle using its color value
 	void fill();
 
+	// true if the triangle is entirely behind what's already in the z buffer,
+	// according to the hierarchical z buffer
+	bool isOccluded();
+
+	// only the part of the triangle inside the given screen rectangle (bounds are
+	// inclusive), so that a tile's thread only reads the depth tiles it draws,
+	// see TileRasterizer
+	bool isOccluded(int min_x, int min_y, int max_x, int max_y);
+
+	// the texture's mip level that best matches how many texels the triangle
+	// covers per pixel on screen, see Texture
+	int mipLevel();
+
 	// draws a triangle using its texture and lighting intensities using a
 	// horizontal scanline approach
 	void fillShaded();
@@ -61,6 +129,20 @@ struct Triangle2D {
 	// barycentric bounding box approach
 	void fillBarycentric();
 
+	// same as above, but only draws the part of the triangle that's inside the
+	// given screen rectangle (bounds are inclusive), so separate parts of the
+	// screen can be drawn in parallel, see TileRasterizer
+	void fillBarycentric(int min_x, int min_y, int max_x, int max_y);
+
+	// draws a triangle using its texture and lighting intensities by walking
+	// its bounding box with incremental fixed point edge functions, several
+	// pixels at a time with SIMD.  Follows the top-left fill rule, and
+	// interpolates everything perspective correctly (including lighting).
+	void fillEdgeFunction();
+
+	// limited to a screen rectangle, like fillBarycentric() above
+	void fillEdgeFunction(int min_x, int min_y, int max_x, int max_y);
+
 	void drawShadedLine(
 			int y,
 			int x1,
@@ -72,7 +154,8 @@ struct Triangle2D {
 			double inv_u1,
 			double inv_v1,
 			double inv_u2,
-			double inv_v2);
+			double inv_v2,
+			int mip_level);
 };
 
 #endif
@@ -0,0 +1,96 @@
+#if defined(__AVX__)
+#include <immintrin.h>
+#define TRANSFORM_SIMD_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TRANSFORM_SIMD_WIDTH 4
+#else
+#define TRANSFORM_SIMD_WIDTH 1
+#endif
+
+#include "vertex_stream.h"
+
+
+static_assert(
+		kVertexStreamPadding % TRANSFORM_SIMD_WIDTH == 0,
+		"transformPoints() runs past the end of the points to the end of the padding");
+
+
+void transformPoints(const AffineTransform& transform, const VertexStream& source, VertexStream& result) {
+	result.resize(source.size());
+
+	// points have w = 1, so the last column is just added on
+	float m[3][4];
+
+	for (int row = 0; row < 3; row++) {
+		for (int column = 0; column < 4; column++) {
+			m[row][column] = transform.at(row, column);
+		}
+	}
+
+	const float* xs = source.x.data();
+	const float* ys = source.y.data();
+	const float* zs = source.z.data();
+	float* outputs[3] = {result.x.data(), result.y.data(), result.z.data()};
+	size_t count = source.x.size();
+
+#if TRANSFORM_SIMD_WIDTH == 8
+	__m256 columns[3][4];
+
+	for (int row = 0; row < 3; row++) {
+		for (int column = 0; column < 4; column++) {
+			columns[row][column] = _mm256_set1_ps(m[row][column]);
+		}
+	}
+
+	for (size_t i = 0; i < count; i += 8) {
+		__m256 x = _mm256_load_ps(xs + i);
+		__m256 y = _mm256_load_ps(ys + i);
+		__m256 z = _mm256_load_ps(zs + i);
+
+		for (int row = 0; row < 3; row++) {
+			__m256 sum = _mm256_add_ps(
+					_mm256_add_ps(
+							_mm256_mul_ps(columns[row][0], x),
+							_mm256_mul_ps(columns[row][1], y)),
+					_mm256_add_ps(
+							_mm256_mul_ps(columns[row][2], z),
+							columns[row][3]));
+
+			_mm256_store_ps(outputs[row] + i, sum);
+		}
+	}
+#elif TRANSFORM_SIMD_WIDTH == 4
+	__m128 columns[3][4];
+
+	for (int row = 0; row < 3; row++) {
+		for (int column = 0; column < 4; column++) {
+			columns[row][column] = _mm_set1_ps(m[row][column]);
+		}
+	}
+
+	for (size_t i = 0; i < count; i += 4) {
+		__m128 x = _mm_load_ps(xs + i);
+		__m128 y = _mm_load_ps(ys + i);
+		__m128 z = _mm_load_ps(zs + i);
+
+		for (int row = 0; row < 3; row++) {
+			__m128 sum = _mm_add_ps(
+					_mm_add_ps(
+							_mm_mul_ps(columns[row][0], x),
+							_mm_mul_ps(columns[row][1], y)),
+					_mm_add_ps(
+							_mm_mul_ps(columns[row][2], z),
+							columns[row][3]));
+
+			_mm_store_ps(outputs[row] + i, sum);
+		}
+	}
+#else
+	for (size_t i = 0; i < count; i++) {
+		for (int row = 0; row < 3; row++) {
+			outputs[row][i] = m[row][0] * xs[i] + m[row][1] * ys[i] + m[row][2] * zs[i] + m[row][3];
+		}
+	}
+#endif
+}
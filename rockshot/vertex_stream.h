@@ -0,0 +1,102 @@
+#ifndef BUFFDOG_VERTEX_STREAM
+#define BUFFDOG_VERTEX_STREAM
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+#include "../matrix.h"
+#include "../util.h"
+#include "../vector.h"
+
+
+// every array is padded to a multiple of this many floats, so that
+// transformPoints() can always work on whole SIMD registers (8 for AVX)
+constexpr size_t kVertexStreamPadding = 8;
+
+
+// like ScratchBuffer, each array starts on its own cache line
+template <typename T>
+struct CacheLineAllocator {
+	typedef T value_type;
+
+	CacheLineAllocator() = default;
+
+	template <typename U>
+	CacheLineAllocator(const CacheLineAllocator<U>&) {}
+
+	T* allocate(size_t count) {
+		T* elements = static_cast<T*>(util::alignedAlloc(util::kCacheLineSize, count * sizeof(T)));
+
+		if (!elements) {
+			throw std::bad_alloc();
+		}
+
+		return elements;
+	}
+
+	void deallocate(T* elements, size_t) {
+		util::alignedFree(elements);
+	}
+
+	template <typename U>
+	bool operator==(const CacheLineAllocator<U>&) const {
+		return true;
+	}
+
+	template <typename U>
+	bool operator!=(const CacheLineAllocator<U>&) const {
+		return false;
+	}
+};
+
+typedef std::vector<float, CacheLineAllocator<float> > FloatArray;
+
+// Points stored as separate x, y and z arrays of floats (structure of
+// arrays), rather than as Vectors of four doubles, so that whole models can
+// be transformed several points at a time, see transformPoints().  A point takes
+// 12 bytes instead of 32, and floats are plenty for positions the size of a
+// level.
+struct VertexStream {
+	FloatArray x;
+	FloatArray y;
+	FloatArray z;
+
+	size_t size() const {
+		return this->count;
+	}
+
+	// the arrays' contents are kept, apart from the padding
+	void resize(size_t count) {
+		size_t padded = (count + kVertexStreamPadding - 1) / kVertexStreamPadding * kVertexStreamPadding;
+
+		this->x.resize(padded);
+		this->y.resize(padded);
+		this->z.resize(padded);
+		this->count = count;
+	}
+
+	void setPoints(const std::vector<Vector>& points) {
+		this->resize(points.size());
+
+		for (size_t i = 0; i < points.size(); i++) {
+			this->x[i] = points[i].x;
+			this->y[i] = points[i].y;
+			this->z[i] = points[i].z;
+		}
+	}
+
+	Vector point(size_t index) const {
+		return Vector::point(this->x[index], this->y[index], this->z[index]);
+	}
+
+private:
+	size_t count = 0;
+};
+
+// result is resized to fit and filled with transform times each of source's
+// points, 8 at a time with AVX, 4 with SSE, or one at a time
+// result can't be source
+void transformPoints(const AffineTransform& transform, const VertexStream& source, VertexStream& result);
+
+#endif
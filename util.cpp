@@ -1,3 +1,4 @@
+#include <cstdlib>
 #include <fstream>
 #include <random>
 #include <stdexcept>
@@ -33,4 +34,22 @@ namespace util {
 
 		return std::vector<unsigned char>(std::istreambuf_iterator<char>(file), {});
 	}
+
+	void* alignedAlloc(size_t alignment, size_t size) {
+		size = (size + alignment - 1) & ~(alignment - 1);
+
+#ifdef _MSC_VER
+		return _aligned_malloc(size, alignment);
+#else
+		return std::aligned_alloc(alignment, size);
+#endif
+	}
+
+	void alignedFree(void* memory) {
+#ifdef _MSC_VER
+		_aligned_free(memory);
+#else
+		std::free(memory);
+#endif
+	}
 }
@@ -1,3 +1,7 @@
+#ifndef BUFFDOG_UTIL
+#define BUFFDOG_UTIL
+
+#include <cstddef>
 #include <vector>
 
 namespace util {
@@ -8,4 +12,16 @@ namespace util {
 	int randomInt(int lower_bound, int upper_bound);
 
 	std::vector<unsigned char> readFile(const char* filename);
+
+	// the alignment for buffers that should start on their own cache line, so
+	// they never share one with anything else and SIMD loads from the start are
+	// aligned
+	constexpr size_t kCacheLineSize = 64;
+
+	// size is rounded up to a multiple of alignment, which must be a power of two
+	// memory must be released with alignedFree()
+	void* alignedAlloc(size_t alignment, size_t size);
+	void alignedFree(void* memory);
 }
+
+#endif
@@ -66,15 +66,8 @@ struct Vector {
 		};
 	}
 
-	// can't be marked const because at() returns a reference
-	double dotProduct(Vector other) {
-		double result = 0;
-
-		for (int i = 0; i < 4; i++) {
-			result += this->at(i) * other.at(i);
-		}
-
-		return result;
+	double dotProduct(const Vector& other) const {
+		return this->x * other.x + this->y * other.y + this->z * other.z + this->w * other.w;
 	}
 
 	// only valid in three (or seven) dimensions!